@@ -0,0 +1,784 @@
+#include "SpatialHash.h"
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+
+using Clock = chrono::steady_clock;
+
+/// <summary>
+/// Settings for the benchmark. The list settings are swept, every combination of them is run once per workload.
+/// </summary>
+struct BenchmarkSettings
+{
+    vector<string> workloads{ "uniform", "clustered", "crowd" };
+    vector<uint32_t> sidePowers{ 8 };
+    vector<float> cellSizes{ 0.0f };
+    vector<string> hashModes{ "wrapped" };
+    vector<float> distances{ 64.0f };
+    vector<int32_t> maxEntities{ 8 };
+
+    uint32_t nrEntries = 100000;
+    float worldSize = 16384.0f;
+    int32_t nrQueries = 50000;
+    uint32_t nrSteps = 10;
+    uint32_t nrLatencySamples = 1000;
+    uint32_t nrChecked = 200;
+    uint32_t seed = 1;
+    uint32_t compact = 0;
+    uint32_t nrLayers = 0;
+    float hysteresis = 0.0f;
+};
+
+/// <summary>
+/// What one run of the benchmark measured.
+/// </summary>
+struct BenchmarkResult
+{
+    uint32_t sidePower;
+    float cellSize;
+    double aliasedPercent;
+    double initMs;
+    double updatesPerSecond;
+    double queriesPerSecond;
+    double p50Us;
+    double p99Us;
+    uint32_t nrChecked;
+    uint32_t nrFailed;
+    string failedChecks;
+    SpatialHashStats stats;
+};
+
+/// <summary>
+/// Moves the entities of a workload between updates.
+/// uniform: spread over the whole world, every entity takes a small random step.
+/// clustered: gathered in a few dense clusters, every entity takes a small random step.
+/// crowd: every entity walks towards a goal and picks a new one when it gets there.
+/// </summary>
+class Workload
+{
+public:
+    Workload(const string& inName, uint32_t nrEntries, float inWorldSize, float inStepLength, uint32_t seed)
+        : name(inName), worldSize(inWorldSize), stepLength(inStepLength), random(seed), entries(nrEntries), goals(nrEntries)
+    {
+        uniform_real_distribution<float> anywhere(0.0f, worldSize);
+
+        vector<Position> clusters(32);
+        for (size_t i = 0; i != clusters.size(); i++)
+        {
+            clusters[i] = Position(anywhere(random), anywhere(random));
+        }
+
+        normal_distribution<float> aroundCluster(0.0f, worldSize / 128);
+        uniform_int_distribution<size_t> anyCluster(0, clusters.size() - 1);
+
+        for (uint32_t i = 0; i < nrEntries; i++)
+        {
+            Position position(anywhere(random), anywhere(random));
+
+            if (name == "clustered")
+            {
+                const Position& cluster = clusters[anyCluster(random)];
+                position = Position(Wrap(cluster.x + aroundCluster(random)), Wrap(cluster.y + aroundCluster(random)));
+            }
+
+            entries[i] = Entry(i, position);
+            goals[i] = Position(anywhere(random), anywhere(random));
+        }
+    }
+
+    void Step()
+    {
+        uniform_real_distribution<float> jitter(-stepLength, stepLength);
+        uniform_real_distribution<float> anywhere(0.0f, worldSize);
+
+        for (size_t i = 0; i != entries.size(); i++)
+        {
+            Position& position = entries[i].position;
+
+            if (name == "crowd")
+            {
+                float dx = goals[i].x - position.x;
+                float dy = goals[i].y - position.y;
+                float length = sqrtf(dx * dx + dy * dy);
+
+                if (length <= stepLength)
+                {
+                    position = goals[i];
+                    goals[i] = Position(anywhere(random), anywhere(random));
+                }
+                else
+                {
+                    position.x += dx / length * stepLength;
+                    position.y += dy / length * stepLength;
+                }
+            }
+            else
+            {
+                position.x = Wrap(position.x + jitter(random));
+                position.y = Wrap(position.y + jitter(random));
+            }
+        }
+    }
+
+    // Query positions close to random entities, since that's where queries usually come from.
+    void QueryPositions(vector<Position>& positions)
+    {
+        uniform_int_distribution<size_t> anyEntry(0, entries.size() - 1);
+        uniform_real_distribution<float> jitter(-stepLength, stepLength);
+
+        for (size_t i = 0; i != positions.size(); i++)
+        {
+            const Position& position = entries[anyEntry(random)].position;
+            positions[i] = Position(Wrap(position.x + jitter(random)), Wrap(position.y + jitter(random)));
+        }
+    }
+
+    vector<Entry>& Entries() { return entries; }
+
+private:
+    string name;
+    float worldSize;
+    float stepLength;
+    mt19937 random;
+    vector<Entry> entries;
+    vector<Position> goals;
+
+    float Wrap(float x) const
+    {
+        return x < 0.0f ? x + worldSize : (x >= worldSize ? x - worldSize : x);
+    }
+};
+
+double MillisecondsSince(Clock::time_point start)
+{
+    return chrono::duration<double, milli>(Clock::now() - start).count();
+}
+
+/// <summary>
+/// The distances to the maxEntities closest entries within d of a position, found by testing every entry.
+/// With layers, only the entries of the first layer are tested, see Run().
+/// </summary>
+vector<float> BruteForce(const vector<Entry>& entries, Position position, float d, int32_t maxEntities, uint32_t nrLayers)
+{
+    vector<float> distances;
+
+    for (size_t i = 0; i != entries.size(); i++)
+    {
+        if (nrLayers != 0 && i % nrLayers != 0)
+        {
+            continue;
+        }
+
+        float dx = entries[i].position.x - position.x;
+        float dy = entries[i].position.y - position.y;
+        float distance = sqrtf(dx * dx + dy * dy);
+
+        if (distance < d)
+        {
+            distances.push_back(distance);
+        }
+    }
+
+    sort(distances.begin(), distances.end());
+
+    if (distances.size() > static_cast<size_t>(maxEntities))
+    {
+        distances.resize(maxEntities);
+    }
+
+    return distances;
+}
+
+/// <summary>
+/// Checks the result of one search against brute force. The distances have to be the same, the ids only have to
+/// belong to entries at those distances since entries that are equally far away can come in any order.
+/// Entries right at the edge of d can go either way because of rounding, so they are allowed to differ.
+/// Compact cells give distances that are off by a little, up to slack, see SetCompact().
+/// </summary>
+bool CheckSearch(const vector<Entry>& entries, Position position, float d, int32_t maxEntities, uint32_t nrLayers, float slack, const IdWithDistance* found, uint32_t nrFound)
+{
+    constexpr float tolerance = 1e-3f;
+
+    vector<float> expected = BruteForce(entries, position, d, maxEntities, nrLayers);
+
+    if (nrFound != expected.size())
+    {
+        bool edgeCase = nrFound + 1 == expected.size() && expected.back() > d - tolerance * d;
+        if (!edgeCase)
+        {
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < nrFound; i++)
+    {
+        const Position& entryPosition = entries[found[i].id].position;
+        float dx = entryPosition.x - position.x;
+        float dy = entryPosition.y - position.y;
+        float distance = sqrtf(dx * dx + dy * dy);
+
+        float allowed = tolerance * max(1.0f, distance) + slack;
+        if (fabs(distance - found[i].distance) > allowed || fabs(expected[i] - found[i].distance) > allowed)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/// <summary>
+/// Checks the result of a search of another shape against brute force. test(position, distance) tells if an entry
+/// is in the shape and how far it is, the same way the Spatial Hash does, so the same entries have to be found.
+/// </summary>
+bool CheckShape(const vector<Entry>& entries, const function<bool(const Position&, double&)>& test, int32_t maxEntities, float slack, const IdWithDistance* found, uint32_t nrFound)
+{
+    constexpr float tolerance = 1e-3f;
+
+    vector<double> expected;
+    for (const Entry& entry : entries)
+    {
+        double distance;
+        if (test(entry.position, distance))
+        {
+            expected.push_back(distance);
+        }
+    }
+
+    sort(expected.begin(), expected.end());
+
+    if (nrFound != min(expected.size(), static_cast<size_t>(max(0, maxEntities))))
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < nrFound; i++)
+    {
+        double distance;
+        if (!test(entries[found[i].id].position, distance))
+        {
+            return false;
+        }
+
+        float allowed = tolerance * max(1.0f, found[i].distance) + slack;
+        if (fabs(distance - found[i].distance) > allowed || fabs(expected[i] - found[i].distance) > allowed)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/// <summary>
+/// Checks the k nearest entries of a position against brute force. The furthest of them has to be as far
+/// away as the k:th closest entry.
+/// </summary>
+bool CheckNearest(const vector<Entry>& entries, Position position, int32_t k, float slack, const IdWithDistance* found, uint32_t nrFound)
+{
+    constexpr float tolerance = 1e-3f;
+
+    vector<float> distances(entries.size());
+    for (size_t i = 0; i != entries.size(); i++)
+    {
+        float dx = entries[i].position.x - position.x;
+        float dy = entries[i].position.y - position.y;
+        distances[i] = sqrtf(dx * dx + dy * dy);
+    }
+
+    if (k <= 0 || nrFound != min(distances.size(), static_cast<size_t>(k)))
+    {
+        return nrFound == 0 && (k <= 0 || distances.empty());
+    }
+
+    nth_element(distances.begin(), distances.begin() + (nrFound - 1), distances.end());
+
+    for (uint32_t i = 0; i < nrFound; i++)
+    {
+        float dx = entries[found[i].id].position.x - position.x;
+        float dy = entries[found[i].id].position.y - position.y;
+        float allowed = tolerance * max(1.0f, found[i].distance) + slack;
+
+        if (fabs(sqrtf(dx * dx + dy * dy) - found[i].distance) > allowed || (i != 0 && found[i].distance < found[i - 1].distance))
+        {
+            return false;
+        }
+    }
+
+    return fabs(distances[nrFound - 1] - found[nrFound - 1].distance) <= tolerance * max(1.0f, distances[nrFound - 1]) + slack;
+}
+
+/// <summary>
+/// Checks pairs of entries, each as first id << 32 | second id, against the ones found by brute force. Pairs
+/// with entries right at the edge of d can go either way because of rounding, so they are allowed to differ.
+/// </summary>
+bool CheckPairs(const vector<Entry>& entries, float d, float slack, vector<uint64_t>& expected, vector<uint64_t>& found)
+{
+    constexpr float tolerance = 1e-3f;
+
+    sort(expected.begin(), expected.end());
+    sort(found.begin(), found.end());
+
+    // A pair found twice is as wrong as a missing one.
+    if (adjacent_find(found.begin(), found.end()) != found.end())
+    {
+        return false;
+    }
+
+    vector<uint64_t> differing;
+    set_symmetric_difference(expected.begin(), expected.end(), found.begin(), found.end(), back_inserter(differing));
+
+    for (uint64_t pair : differing)
+    {
+        const Position& first = entries[static_cast<uint32_t>(pair >> 32)].position;
+        const Position& second = entries[static_cast<uint32_t>(pair)].position;
+        float dx = first.x - second.x;
+        float dy = first.y - second.y;
+
+        if (fabs(sqrtf(dx * dx + dy * dy) - d) > tolerance * d + slack)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+double Percentile(vector<double>& samples, double percentile)
+{
+    if (samples.empty())
+    {
+        return 0.0;
+    }
+
+    size_t index = min(samples.size() - 1, static_cast<size_t>(percentile * samples.size()));
+    nth_element(samples.begin(), samples.begin() + index, samples.end());
+
+    return samples[index];
+}
+
+uint32_t HashModeFromName(const string& name)
+{
+    if (name == "hashed")
+    {
+        return static_cast<uint32_t>(HashMode::Hashed);
+    }
+
+    if (name == "bounded")
+    {
+        return static_cast<uint32_t>(HashMode::Bounded);
+    }
+
+    return static_cast<uint32_t>(HashMode::Wrapped);
+}
+
+BenchmarkResult Run(const BenchmarkSettings& settings, const string& workloadName, uint32_t sidePower, float cellSize, const string& hashMode, float d, int32_t maxEntities)
+{
+    BenchmarkResult result{};
+
+    Workload workload(workloadName, settings.nrEntries, settings.worldSize, d / 4, settings.seed);
+    vector<Entry>& entries = workload.Entries();
+
+    // A negative cell size means that the hash picks the sizes itself.
+    SpatialHash* spatialHash = static_cast<SpatialHash*>(StartWithCellSize(sidePower, max(0.0f, cellSize)));
+    SetHashMode(HashModeFromName(hashMode), 0.0f, 0.0f, spatialHash);
+    SetCompact(settings.compact, spatialHash);
+
+    Clock::time_point start = Clock::now();
+    if (cellSize < 0.0f)
+    {
+        SetAutoTune(d, spatialHash);
+    }
+    SetSearchDistance(d, spatialHash);
+    Init(static_cast<uint32_t>(entries.size()), entries.data(), spatialHash);
+    result.initMs = MillisecondsSince(start);
+
+    SetHysteresis(settings.hysteresis, spatialHash);
+
+    // Entry i is in layer i % nrLayers and the searches look in layer 0.
+    const uint32_t layerMask = 1;
+    if (settings.nrLayers != 0)
+    {
+        vector<uint32_t> ids(entries.size());
+        vector<uint32_t> layers(entries.size());
+        for (uint32_t i = 0; i < entries.size(); i++)
+        {
+            ids[i] = i;
+            layers[i] = 1u << (i % settings.nrLayers % 32);
+        }
+
+        SetLayers(static_cast<uint32_t>(entries.size()), ids.data(), layers.data(), spatialHash);
+    }
+
+    // Searches without layers look in all of them.
+    auto Search = [&](int32_t nrPositions, Position* positions)
+    {
+        if (settings.nrLayers == 0)
+        {
+            return GetEntries(nrPositions, positions, d, maxEntities, spatialHash);
+        }
+
+        return GetEntriesInLayers(nrPositions, positions, d, maxEntities, layerMask, spatialHash);
+    };
+
+    result.sidePower = GetTableSize(spatialHash);
+    result.cellSize = GetCellSize(spatialHash);
+
+    vector<Position> queries(settings.nrQueries);
+    vector<double> latencies;
+    double updateMs = 0.0;
+    double queryMs = 0.0;
+
+    for (uint32_t step = 0; step < settings.nrSteps; step++)
+    {
+        workload.Step();
+
+        start = Clock::now();
+        Update(spatialHash);
+        updateMs += MillisecondsSince(start);
+
+        workload.QueryPositions(queries);
+
+        start = Clock::now();
+        Search(settings.nrQueries, queries.data());
+        queryMs += MillisecondsSince(start);
+
+        // Latency is measured for single searches, the way a lone search from the game would be done.
+        for (uint32_t i = 0; i < settings.nrLatencySamples && i < queries.size(); i++)
+        {
+            start = Clock::now();
+            Search(1, &queries[i]);
+            latencies.push_back(MillisecondsSince(start) * 1000.0);
+        }
+    }
+
+    // The counters are for the timed searches and updates, not the ones checked below.
+    GetStats(&result.stats, 1, spatialHash);
+
+    result.updatesPerSecond = settings.nrSteps / (updateMs / 1000.0);
+    result.queriesPerSecond = static_cast<double>(settings.nrQueries) * settings.nrSteps / (queryMs / 1000.0);
+    result.p50Us = Percentile(latencies, 0.50);
+    result.p99Us = Percentile(latencies, 0.99);
+
+    // The searches of the last round are checked against brute force, every kind of search with its own shape.
+    int32_t nrChecked = min(settings.nrQueries, static_cast<int32_t>(settings.nrChecked));
+
+    // A 65533th of two cells along both axes, a little more than the quantization can be off by.
+    const float slack = settings.compact != 0 ? 3.0f * result.cellSize / 65533 : 0.0f;
+
+    // Checks every search of a bulk search with check(i, found, nrFound).
+    auto CheckAll = [&](const char* name, CloseIdsAndNrOf found, const function<bool(int32_t, const IdWithDistance*, uint32_t)>& check)
+    {
+        uint32_t nrFailed = 0;
+        uint32_t searchStart = 0;
+        for (int32_t i = 0; i < nrChecked; i++)
+        {
+            uint32_t searchEnd = found.nrOfEntries[i];
+
+            if (!check(i, found.allCloseEntries + searchStart, searchEnd - searchStart))
+            {
+                nrFailed++;
+            }
+
+            searchStart = searchEnd;
+        }
+
+        result.nrChecked += nrChecked;
+        result.nrFailed += nrFailed;
+
+        if (nrFailed != 0)
+        {
+            result.failedChecks += string(" ") + name;
+        }
+    };
+
+    CheckAll("circle", Search(nrChecked, queries.data()), [&](int32_t i, const IdWithDistance* found, uint32_t nrFound)
+    {
+        return CheckSearch(entries, queries[i], d, maxEntities, settings.nrLayers, slack, found, nrFound);
+    });
+
+    CheckAll("grouped", GetEntriesGrouped(nrChecked, queries.data(), d, maxEntities, spatialHash), [&](int32_t i, const IdWithDistance* found, uint32_t nrFound)
+    {
+        return CheckSearch(entries, queries[i], d, maxEntities, 0, slack, found, nrFound);
+    });
+
+    CheckAll("nearest", GetNearest(nrChecked, queries.data(), maxEntities, spatialHash), [&](int32_t i, const IdWithDistance* found, uint32_t nrFound)
+    {
+        return CheckNearest(entries, queries[i], maxEntities, slack, found, nrFound);
+    });
+
+    // Boxes reaching d from the positions, further along one axis on each side, so they aren't centered on them.
+    vector<Position> lows(nrChecked);
+    vector<Position> highs(nrChecked);
+    for (int32_t i = 0; i < nrChecked; i++)
+    {
+        lows[i] = Position(queries[i].x - d, queries[i].y - d / 2);
+        highs[i] = Position(queries[i].x + d / 2, queries[i].y + d);
+    }
+
+    CheckAll("box", GetEntriesInBoxes(nrChecked, lows.data(), highs.data(), maxEntities, spatialHash), [&](int32_t i, const IdWithDistance* found, uint32_t nrFound)
+    {
+        return CheckShape(entries, [&](const Position& position, double& distance)
+        {
+            if (position.x < lows[i].x || position.x > highs[i].x || position.y < lows[i].y || position.y > highs[i].y)
+            {
+                return false;
+            }
+
+            double dx = position.x - 0.5 * (static_cast<double>(lows[i].x) + highs[i].x);
+            double dy = position.y - 0.5 * (static_cast<double>(lows[i].y) + highs[i].y);
+            distance = sqrt(dx * dx + dy * dy);
+            return true;
+        }, maxEntities, slack, found, nrFound);
+    });
+
+    // Segments from the positions, a few times d long, that entries are within a quarter of d of.
+    const float segmentD = d / 4;
+    vector<Position> ends(nrChecked);
+    for (int32_t i = 0; i < nrChecked; i++)
+    {
+        ends[i] = Position(queries[i].x + 3 * d, queries[i].y + d);
+    }
+
+    CheckAll("segment", GetEntriesAlongSegments(nrChecked, queries.data(), ends.data(), segmentD, maxEntities, spatialHash), [&](int32_t i, const IdWithDistance* found, uint32_t nrFound)
+    {
+        return CheckShape(entries, [&](const Position& position, double& distance)
+        {
+            double directionX = static_cast<double>(ends[i].x) - queries[i].x;
+            double directionY = static_cast<double>(ends[i].y) - queries[i].y;
+            double relativeX = position.x - static_cast<double>(queries[i].x);
+            double relativeY = position.y - static_cast<double>(queries[i].y);
+            double lengthSquared = directionX * directionX + directionY * directionY;
+
+            double t = min(1.0, max(0.0, (relativeX * directionX + relativeY * directionY) / lengthSquared));
+            double gapX = relativeX - t * directionX;
+            double gapY = relativeY - t * directionY;
+
+            if (gapX * gapX + gapY * gapY >= static_cast<double>(segmentD) * segmentD)
+            {
+                return false;
+            }
+
+            distance = t * sqrt(lengthSquared);
+            return true;
+        }, maxEntities, slack, found, nrFound);
+    });
+
+    // Pairs are checked for the first entries, nrChecked of them, with every other entry.
+    const uint32_t nrPairChecked = min(static_cast<uint32_t>(entries.size()), static_cast<uint32_t>(max(0, nrChecked)));
+    auto PairOf = [](uint32_t first, uint32_t second) { return static_cast<uint64_t>(first) << 32 | second; };
+
+    vector<uint64_t> expectedPairs;
+    for (uint32_t i = 0; i < nrPairChecked; i++)
+    {
+        for (uint32_t j = 0; j < entries.size(); j++)
+        {
+            float dx = entries[i].position.x - entries[j].position.x;
+            float dy = entries[i].position.y - entries[j].position.y;
+
+            if (j != i && sqrtf(dx * dx + dy * dy) < d)
+            {
+                expectedPairs.push_back(PairOf(i, j));
+            }
+        }
+    }
+
+    // Every pair once, with the lower id first, for the pair set. Pairs of two checked entries are there both ways.
+    vector<uint64_t> expectedUnordered;
+    for (uint64_t pair : expectedPairs)
+    {
+        if (static_cast<uint32_t>(pair >> 32) < static_cast<uint32_t>(pair))
+        {
+            expectedUnordered.push_back(pair);
+        }
+    }
+
+    ClosePairsAndNrOf pairs = GetPairs(d, spatialHash);
+    vector<uint64_t> foundPairs;
+    for (uint32_t i = 0; i < pairs.nrOfPairs; i++)
+    {
+        uint32_t first = min(pairs.pairs[i].first, pairs.pairs[i].second);
+        uint32_t second = max(pairs.pairs[i].first, pairs.pairs[i].second);
+        if (first < nrPairChecked)
+        {
+            foundPairs.push_back(PairOf(first, second));
+        }
+    }
+
+    bool pairsPassed = CheckPairs(entries, d, slack, expectedUnordered, foundPairs);
+
+    CloseIdsAndNrOf neighbours = GetNeighbours(d, spatialHash);
+    vector<uint64_t> foundNeighbours;
+    for (uint32_t i = 0; i < nrPairChecked; i++)
+    {
+        for (uint32_t j = i == 0 ? 0 : neighbours.nrOfEntries[i - 1]; j < neighbours.nrOfEntries[i]; j++)
+        {
+            foundNeighbours.push_back(PairOf(i, neighbours.allCloseEntries[j].id));
+        }
+    }
+
+    bool neighboursPassed = CheckPairs(entries, d, slack, expectedPairs, foundNeighbours);
+
+    result.nrChecked += 2;
+    result.nrFailed += (pairsPassed ? 0 : 1) + (neighboursPassed ? 0 : 1);
+    result.failedChecks += string(pairsPassed ? "" : " pairs") + (neighboursPassed ? "" : " neighbours");
+
+    AliasingStats aliasing = GetAliasing(spatialHash);
+    result.aliasedPercent = aliasing.occupiedCells == 0 ? 0.0 : 100.0 * aliasing.aliasedCells / aliasing.occupiedCells;
+
+    Stop(spatialHash);
+
+    return result;
+}
+
+/// <summary>
+/// Prints what the searches and updates of a run did, per search and per update.
+/// </summary>
+void PrintStats(const SpatialHashStats& stats)
+{
+    double searches = max<double>(1.0, static_cast<double>(stats.searches));
+    double updates = max<double>(1.0, static_cast<double>(stats.updates));
+    double tested = max<double>(1.0, static_cast<double>(stats.candidatesTested));
+
+    printf("  per search: %.1f steps, %.1f cells visited, %.1f skipped, %.1f tested, %.1f%% hits, %.1f%% aliased."
+        " per update: %.0f migrations, %.2f ms. rebuilds: %llu, %.2f ms. max occupancy: %u\n",
+        stats.stepsWalked / searches, stats.cellsVisited / searches, stats.cellsSkipped / searches, stats.candidatesTested / searches,
+        100.0 * stats.hits / tested, 100.0 * stats.aliasingRejections / tested, stats.migrations / updates, stats.updateMs / updates,
+        static_cast<unsigned long long>(stats.rebuilds), stats.rebuildMs, stats.maxOccupancy);
+}
+
+template<typename T>
+vector<T> ParseList(const char* text, T (*parse)(const char*))
+{
+    vector<T> values;
+    string all(text);
+
+    size_t start = 0;
+    while (start <= all.size())
+    {
+        size_t end = all.find(',', start);
+        if (end == string::npos)
+        {
+            end = all.size();
+        }
+
+        values.push_back(parse(all.substr(start, end - start).c_str()));
+        start = end + 1;
+    }
+
+    return values;
+}
+
+uint32_t ParseUnsigned(const char* text) { return static_cast<uint32_t>(strtoul(text, nullptr, 10)); }
+int32_t ParseInt(const char* text) { return static_cast<int32_t>(strtol(text, nullptr, 10)); }
+float ParseFloat(const char* text) { return strtof(text, nullptr); }
+string ParseString(const char* text) { return string(text); }
+float ParseCellSize(const char* text) { return strcmp(text, "auto") == 0 ? -1.0f : strtof(text, nullptr); }
+
+void PrintUsage()
+{
+    printf("SpatialBenchmark [options]\n"
+        "  --workload uniform,clustered,crowd   Workloads to run.\n"
+        "  --side 8                             Table side powers, the table is 2^side cells wide.\n"
+        "  --cell 0                             Cell sizes, 0 for as wide as the table is in cells, auto to tune for d.\n"
+        "  --mode wrapped                       Hash modes, wrapped, hashed or bounded.\n"
+        "  --d 64                               Search distances.\n"
+        "  --k 8                                Max entities per search.\n"
+        "  --entries 100000                     Number of entries.\n"
+        "  --world 16384                        Side length of the world the entries are in.\n"
+        "  --queries 50000                      Searches per bulk search.\n"
+        "  --steps 10                           Number of update and search rounds.\n"
+        "  --latency 1000                       Single searches timed per round.\n"
+        "  --check 200                          Searches of every kind, and pairs of entries, checked against brute force.\n"
+        "  --seed 1                             Seed for the random positions.\n"
+        "  --compact 0                          1 for compact cells.\n"
+        "  --layers 0                           Layers the entries are spread over, searches look in one. 0 for none.\n"
+        "  --hysteresis 0                       How far entries can move out of their cells before they are moved.\n"
+        "Lists are comma separated, every combination is run.\n");
+}
+
+int main(int argc, char** argv)
+{
+    BenchmarkSettings settings;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string option(argv[i]);
+
+        if (option == "--help" || i + 1 >= argc)
+        {
+            PrintUsage();
+            return option == "--help" ? 0 : 1;
+        }
+
+        const char* value = argv[++i];
+
+        if (option == "--workload") settings.workloads = ParseList(value, ParseString);
+        else if (option == "--side") settings.sidePowers = ParseList(value, ParseUnsigned);
+        else if (option == "--cell") settings.cellSizes = ParseList(value, ParseCellSize);
+        else if (option == "--mode") settings.hashModes = ParseList(value, ParseString);
+        else if (option == "--d") settings.distances = ParseList(value, ParseFloat);
+        else if (option == "--k") settings.maxEntities = ParseList(value, ParseInt);
+        else if (option == "--entries") settings.nrEntries = ParseUnsigned(value);
+        else if (option == "--world") settings.worldSize = ParseFloat(value);
+        else if (option == "--queries") settings.nrQueries = ParseInt(value);
+        else if (option == "--steps") settings.nrSteps = ParseUnsigned(value);
+        else if (option == "--latency") settings.nrLatencySamples = ParseUnsigned(value);
+        else if (option == "--check") settings.nrChecked = ParseUnsigned(value);
+        else if (option == "--seed") settings.seed = ParseUnsigned(value);
+        else if (option == "--compact") settings.compact = ParseUnsigned(value);
+        else if (option == "--layers") settings.nrLayers = ParseUnsigned(value);
+        else if (option == "--hysteresis") settings.hysteresis = ParseFloat(value);
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    printf("%-10s %4s %8s %-8s %8s %4s %9s %9s %10s %12s %9s %9s %8s %s\n",
+        "workload", "side", "cell", "mode", "d", "k", "entries", "init ms", "updates/s", "queries/s", "p50 us", "p99 us", "aliased", "check");
+
+    bool allPassed = true;
+
+    for (const string& workload : settings.workloads)
+    {
+        for (uint32_t sidePower : settings.sidePowers)
+        {
+            for (float cellSize : settings.cellSizes)
+            {
+                for (const string& hashMode : settings.hashModes)
+                {
+                    for (float d : settings.distances)
+                    {
+                        for (int32_t maxEntities : settings.maxEntities)
+                        {
+                            BenchmarkResult result = Run(settings, workload, sidePower, cellSize, hashMode, d, maxEntities);
+
+                            printf("%-10s %4u %8.1f %-8s %8.1f %4d %9u %9.2f %10.1f %12.0f %9.2f %9.2f %7.1f%% %s (%u/%u)%s\n",
+                                workload.c_str(), result.sidePower, result.cellSize, hashMode.c_str(), d, maxEntities, settings.nrEntries, result.initMs,
+                                result.updatesPerSecond, result.queriesPerSecond, result.p50Us, result.p99Us, result.aliasedPercent,
+                                result.nrFailed == 0 ? "ok" : "FAILED", result.nrChecked - result.nrFailed, result.nrChecked, result.failedChecks.c_str());
+
+                            // Only there when the library is built with SPATIALHASH_STATS.
+                            if (result.stats.enabled)
+                            {
+                                PrintStats(result.stats);
+                            }
+
+                            allPassed = allPassed && result.nrFailed == 0;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    return allPassed ? 0 : 1;
+}
@@ -0,0 +1,482 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// SSE2 is used when the compiler is allowed to, there is a scalar version as well. On x86 there are also AVX2
+// versions, built for AVX2 whatever the rest is built for and only run if the processor has it, see HasAvx2().
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SPATIALHASH_SSE2
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86)
+#include <immintrin.h>
+#define SPATIALHASH_AVX2
+#define SPATIALHASH_TARGET_AVX2
+#elif (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define SPATIALHASH_AVX2
+#define SPATIALHASH_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+/// <summary>
+/// Index of the lowest set bit, mask must not be zero.
+/// </summary>
+inline uint32_t LowestSetBit(uint32_t mask)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return static_cast<uint32_t>(__builtin_ctz(mask));
+#endif
+}
+
+/// <summary>
+/// True if the processor running this has AVX2, and the operating system saves the AVX registers.
+/// Found out the first time it's asked.
+/// </summary>
+inline bool HasAvx2()
+{
+#if defined(__AVX2__)
+    return true;
+#elif defined(SPATIALHASH_AVX2) && defined(_MSC_VER)
+    static const bool hasAvx2 = []()
+    {
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+        {
+            return false;
+        }
+
+        // OSXSAVE and AVX, then that the AVX registers are saved, then AVX2.
+        __cpuid(info, 1);
+        if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6)
+        {
+            return false;
+        }
+
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+    }();
+
+    return hasAvx2;
+#elif defined(SPATIALHASH_AVX2)
+    static const bool hasAvx2 = __builtin_cpu_supports("avx2") != 0;
+    return hasAvx2;
+#else
+    return false;
+#endif
+}
+
+/// <summary>
+/// The vector instructions the distance kernel is built from, for float and double lanes.
+/// Matching() tells which lanes have a layer mask that shares a bit with mask, one bit per lane.
+/// DistanceLanes is SSE2, DistanceLanesAvx2 is AVX2 and may only be used once HasAvx2() is true.
+/// </summary>
+template<typename Scalar>
+struct DistanceLanes;
+
+template<typename Scalar>
+struct DistanceLanesAvx2;
+
+#if defined(SPATIALHASH_AVX2)
+template<>
+struct DistanceLanesAvx2<float>
+{
+    using Vector = __m256;
+    static constexpr uint32_t width = 8;
+
+    SPATIALHASH_TARGET_AVX2 static Vector Set(float value) { return _mm256_set1_ps(value); }
+    SPATIALHASH_TARGET_AVX2 static Vector Load(const float* values) { return _mm256_loadu_ps(values); }
+    SPATIALHASH_TARGET_AVX2 static Vector Sub(Vector a, Vector b) { return _mm256_sub_ps(a, b); }
+    SPATIALHASH_TARGET_AVX2 static Vector Mul(Vector a, Vector b) { return _mm256_mul_ps(a, b); }
+    SPATIALHASH_TARGET_AVX2 static Vector Add(Vector a, Vector b) { return _mm256_add_ps(a, b); }
+    SPATIALHASH_TARGET_AVX2 static uint32_t Less(Vector a, Vector b) { return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_LT_OQ))); }
+    SPATIALHASH_TARGET_AVX2 static void Store(float* values, Vector a) { _mm256_store_ps(values, a); }
+    SPATIALHASH_TARGET_AVX2 static uint32_t Matching(const uint32_t* layers, uint32_t mask)
+    {
+        __m256i shared = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(layers)), _mm256_set1_epi32(static_cast<int32_t>(mask)));
+        return ~static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(shared, _mm256_setzero_si256())))) & 0xFF;
+    }
+};
+
+template<>
+struct DistanceLanesAvx2<double>
+{
+    using Vector = __m256d;
+    static constexpr uint32_t width = 4;
+
+    SPATIALHASH_TARGET_AVX2 static Vector Set(double value) { return _mm256_set1_pd(value); }
+    SPATIALHASH_TARGET_AVX2 static Vector Load(const double* values) { return _mm256_loadu_pd(values); }
+    SPATIALHASH_TARGET_AVX2 static Vector Sub(Vector a, Vector b) { return _mm256_sub_pd(a, b); }
+    SPATIALHASH_TARGET_AVX2 static Vector Mul(Vector a, Vector b) { return _mm256_mul_pd(a, b); }
+    SPATIALHASH_TARGET_AVX2 static Vector Add(Vector a, Vector b) { return _mm256_add_pd(a, b); }
+    SPATIALHASH_TARGET_AVX2 static uint32_t Less(Vector a, Vector b) { return static_cast<uint32_t>(_mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_LT_OQ))); }
+    SPATIALHASH_TARGET_AVX2 static void Store(double* values, Vector a) { _mm256_store_pd(values, a); }
+    SPATIALHASH_TARGET_AVX2 static uint32_t Matching(const uint32_t* layers, uint32_t mask)
+    {
+        __m128i shared = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(layers)), _mm_set1_epi32(static_cast<int32_t>(mask)));
+        return ~static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(shared, _mm_setzero_si128())))) & 0xF;
+    }
+};
+#endif
+
+#if defined(SPATIALHASH_SSE2)
+template<>
+struct DistanceLanes<float>
+{
+    using Vector = __m128;
+    static constexpr uint32_t width = 4;
+
+    static Vector Set(float value) { return _mm_set1_ps(value); }
+    static Vector Load(const float* values) { return _mm_loadu_ps(values); }
+    static Vector Sub(Vector a, Vector b) { return _mm_sub_ps(a, b); }
+    static Vector Mul(Vector a, Vector b) { return _mm_mul_ps(a, b); }
+    static Vector Add(Vector a, Vector b) { return _mm_add_ps(a, b); }
+    static uint32_t Less(Vector a, Vector b) { return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmplt_ps(a, b))); }
+    static void Store(float* values, Vector a) { _mm_store_ps(values, a); }
+    static uint32_t Matching(const uint32_t* layers, uint32_t mask)
+    {
+        __m128i shared = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(layers)), _mm_set1_epi32(static_cast<int32_t>(mask)));
+        return ~static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(shared, _mm_setzero_si128())))) & 0xF;
+    }
+};
+
+template<>
+struct DistanceLanes<double>
+{
+    using Vector = __m128d;
+    static constexpr uint32_t width = 2;
+
+    static Vector Set(double value) { return _mm_set1_pd(value); }
+    static Vector Load(const double* values) { return _mm_loadu_pd(values); }
+    static Vector Sub(Vector a, Vector b) { return _mm_sub_pd(a, b); }
+    static Vector Mul(Vector a, Vector b) { return _mm_mul_pd(a, b); }
+    static Vector Add(Vector a, Vector b) { return _mm_add_pd(a, b); }
+    static uint32_t Less(Vector a, Vector b) { return static_cast<uint32_t>(_mm_movemask_pd(_mm_cmplt_pd(a, b))); }
+    static void Store(double* values, Vector a) { _mm_store_pd(values, a); }
+    static uint32_t Matching(const uint32_t* layers, uint32_t mask)
+    {
+        __m128i shared = _mm_and_si128(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(layers)), _mm_set1_epi32(static_cast<int32_t>(mask)));
+        return ~static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(shared, _mm_setzero_si128())))) & 0x3;
+    }
+};
+#endif
+
+#if defined(SPATIALHASH_AVX2)
+/// <summary>
+/// The AVX2 part of FindWithinDistance(), only to be called if HasAvx2(). Tests whole vectors of points.
+/// </summary>
+/// <returns>How many points were tested, the rest are fewer than a vector.</returns>
+template<uint32_t Dim, typename Scalar, typename Hit>
+SPATIALHASH_TARGET_AVX2 inline uint32_t FindWithinDistanceAvx2(const Scalar* const* coordinates, uint32_t count, const Scalar* position, Scalar dSquared, const uint32_t* layers, uint32_t layerMask, Hit& hit)
+{
+    using Lanes = DistanceLanesAvx2<Scalar>;
+
+    uint32_t m = 0;
+
+    typename Lanes::Vector query[Dim];
+    for (uint32_t axis = 0; axis < Dim; axis++)
+    {
+        query[axis] = Lanes::Set(position[axis]);
+    }
+
+    const typename Lanes::Vector limit = Lanes::Set(dSquared);
+
+    for (; m + Lanes::width <= count; m += Lanes::width)
+    {
+        uint32_t matching = ~0u;
+        if (layers != nullptr)
+        {
+            matching = Lanes::Matching(layers + m, layerMask);
+            if (matching == 0)
+            {
+                continue;
+            }
+        }
+
+        typename Lanes::Vector delta = Lanes::Sub(Lanes::Load(coordinates[0] + m), query[0]);
+        typename Lanes::Vector squared = Lanes::Mul(delta, delta);
+
+        for (uint32_t axis = 1; axis < Dim; axis++)
+        {
+            delta = Lanes::Sub(Lanes::Load(coordinates[axis] + m), query[axis]);
+            squared = Lanes::Add(squared, Lanes::Mul(delta, delta));
+        }
+
+        uint32_t mask = Lanes::Less(squared, limit) & matching;
+
+        // Most of the time nothing is close so the distances are only stored when something is.
+        if (mask != 0)
+        {
+            alignas(32) Scalar distances[Lanes::width];
+            Lanes::Store(distances, squared);
+
+            for (; mask != 0; mask &= mask - 1)
+            {
+                uint32_t bit = LowestSetBit(mask);
+                hit(m + bit, static_cast<float>(distances[bit]));
+            }
+        }
+    }
+
+    return m;
+}
+#endif
+
+/// <summary>
+/// Finds the points that are closer than a distance to a position, in Dim dimensions. Only squared distances
+/// are compared so no square roots are taken here. The points are tested a vector of them at a time, 8 floats
+/// or 4 doubles with AVX2 if the processor has it and half of that with SSE2, the comparisons become a bit mask
+/// and hit(index, squaredDistance) is called for every set bit. The squared distance is given as a float.
+/// With layers, points that share no bit with layerMask are passed over, vectors of only such points without
+/// any distances being tested.
+/// </summary>
+/// <param name="coordinates">For every axis, the coordinates of the points along it.</param>
+/// <param name="count">Number of points.</param>
+/// <param name="position">The position to measure from, Dim coordinates.</param>
+/// <param name="dSquared">The square of the distance inside of which points are close.</param>
+/// <param name="layers">The layer mask of every point, nullptr if every point is wanted.</param>
+/// <param name="layerMask">The layers points have to be in.</param>
+/// <param name="hit">Called with the index and squared distance of every close point, in order.</param>
+template<uint32_t Dim, typename Scalar, typename Hit>
+inline void FindWithinDistance(const Scalar* const* coordinates, uint32_t count, const Scalar* position, Scalar dSquared, const uint32_t* layers, uint32_t layerMask, Hit&& hit)
+{
+    uint32_t m = 0;
+
+#if defined(SPATIALHASH_AVX2)
+    if (HasAvx2())
+    {
+        m = FindWithinDistanceAvx2<Dim>(coordinates, count, position, dSquared, layers, layerMask, hit);
+    }
+#endif
+
+    // With AVX2 this only gets what is left of it that fills an SSE2 vector.
+#if defined(SPATIALHASH_SSE2)
+    using Lanes = DistanceLanes<Scalar>;
+
+    typename Lanes::Vector query[Dim];
+    for (uint32_t axis = 0; axis < Dim; axis++)
+    {
+        query[axis] = Lanes::Set(position[axis]);
+    }
+
+    const typename Lanes::Vector limit = Lanes::Set(dSquared);
+
+    for (; m + Lanes::width <= count; m += Lanes::width)
+    {
+        uint32_t matching = ~0u;
+        if (layers != nullptr)
+        {
+            matching = Lanes::Matching(layers + m, layerMask);
+            if (matching == 0)
+            {
+                continue;
+            }
+        }
+
+        typename Lanes::Vector delta = Lanes::Sub(Lanes::Load(coordinates[0] + m), query[0]);
+        typename Lanes::Vector squared = Lanes::Mul(delta, delta);
+
+        for (uint32_t axis = 1; axis < Dim; axis++)
+        {
+            delta = Lanes::Sub(Lanes::Load(coordinates[axis] + m), query[axis]);
+            squared = Lanes::Add(squared, Lanes::Mul(delta, delta));
+        }
+
+        uint32_t mask = Lanes::Less(squared, limit) & matching;
+
+        // Most of the time nothing is close so the distances are only stored when something is.
+        if (mask != 0)
+        {
+            alignas(32) Scalar distances[Lanes::width];
+            Lanes::Store(distances, squared);
+
+            for (; mask != 0; mask &= mask - 1)
+            {
+                uint32_t bit = LowestSetBit(mask);
+                hit(m + bit, static_cast<float>(distances[bit]));
+            }
+        }
+    }
+#endif
+
+    // What is left after the vectorized loop, or everything if there is no vector instruction set.
+    for (; m < count; m++)
+    {
+        if (layers != nullptr && (layers[m] & layerMask) == 0)
+        {
+            continue;
+        }
+
+        Scalar squared = 0;
+
+        for (uint32_t axis = 0; axis < Dim; axis++)
+        {
+            Scalar delta = coordinates[axis][m] - position[axis];
+            squared += delta * delta;
+        }
+
+        if (squared < dSquared)
+        {
+            hit(m, static_cast<float>(squared));
+        }
+    }
+}
+
+#if defined(SPATIALHASH_AVX2)
+/// <summary>
+/// The AVX2 part of FindQuantizedWithinDistance(), only to be called if HasAvx2(). Tests whole vectors of points
+/// when there are neither unknowns nor side lengths.
+/// </summary>
+/// <returns>How many points were tested.</returns>
+template<uint32_t Dim, typename Candidate>
+SPATIALHASH_TARGET_AVX2 inline uint32_t FindQuantizedWithinDistanceAvx2(const uint16_t* const* quantized, uint32_t count, const float* shift, const float* slack, float step, float limit, float side, bool unknowns, const uint32_t* layers, uint32_t layerMask, Candidate& candidate)
+{
+    uint32_t m = 0;
+
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    const __m256 steps = _mm256_set1_ps(step);
+    const __m256 limits = _mm256_set1_ps(limit);
+
+    for (; side == 0.0f && !unknowns && m + 8 <= count; m += 8)
+    {
+        uint32_t matching = layers != nullptr ? DistanceLanesAvx2<float>::Matching(layers + m, layerMask) : 0xFF;
+        if (matching == 0)
+        {
+            continue;
+        }
+
+        __m256 squared = zero;
+
+        for (uint32_t axis = 0; axis < Dim; axis++)
+        {
+            __m256i wide = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(quantized[axis] + m)));
+            __m256 delta = _mm256_add_ps(_mm256_set1_ps(shift[axis]), _mm256_mul_ps(_mm256_cvtepi32_ps(wide), steps));
+            __m256 gap = _mm256_max_ps(zero, _mm256_sub_ps(_mm256_and_ps(delta, absMask), _mm256_set1_ps(slack[axis])));
+
+            squared = _mm256_add_ps(squared, _mm256_mul_ps(gap, gap));
+        }
+
+        for (uint32_t mask = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(squared, limits, _CMP_LT_OQ))) & matching; mask != 0; mask &= mask - 1)
+        {
+            candidate(m + LowestSetBit(mask));
+        }
+    }
+
+    return m;
+}
+#endif
+
+/// <summary>
+/// Finds the points of compact cells that can be closer than a distance to a position, in Dim dimensions. Along every
+/// axis a point is shift + quantized * step from the position, give or take slack. If there can be unknowns, quantized
+/// values of 0 and 65535 mean that a point could be anywhere along that axis. The smallest squared distance the points
+/// can be at is compared with limit, a vector of them at a time like FindWithinDistance(), and candidate(index) is called
+/// for every point that can be closer. With a side length, the distance along an axis is to the closest of the points
+/// side lengths apart. Unknowns and side lengths are rare, those points are tested one at a time.
+/// Layers are passed over like in FindWithinDistance().
+/// </summary>
+/// <param name="quantized">For every axis, the quantized coordinates of the points along it.</param>
+/// <param name="count">Number of points.</param>
+/// <param name="shift">Where quantized 0 is along every axis, relative to the position.</param>
+/// <param name="slack">How much closer than its quantized coordinate a point can be along every axis.</param>
+/// <param name="step">The length of a step of the quantized coordinates.</param>
+/// <param name="limit">The square of the distance inside of which points can be close.</param>
+/// <param name="side">The side length the points repeat with, 0 if they don't.</param>
+/// <param name="unknowns">If there can be quantized coordinates of 0 and 65535.</param>
+/// <param name="layers">The layer mask of every point, nullptr if every point is wanted.</param>
+/// <param name="layerMask">The layers points have to be in.</param>
+/// <param name="candidate">Called with the index of every point that can be close, in order.</param>
+template<uint32_t Dim, typename Candidate>
+inline void FindQuantizedWithinDistance(const uint16_t* const* quantized, uint32_t count, const float* shift, const float* slack, float step, float limit, float side, bool unknowns, const uint32_t* layers, uint32_t layerMask, Candidate&& candidate)
+{
+    uint32_t m = 0;
+
+#if defined(SPATIALHASH_AVX2)
+    if (HasAvx2())
+    {
+        m = FindQuantizedWithinDistanceAvx2<Dim>(quantized, count, shift, slack, step, limit, side, unknowns, layers, layerMask, candidate);
+    }
+#endif
+
+    // With AVX2 this only gets what is left of it that fills an SSE2 vector.
+#if defined(SPATIALHASH_SSE2)
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    const __m128 steps = _mm_set1_ps(step);
+    const __m128 limits = _mm_set1_ps(limit);
+
+    for (; side == 0.0f && !unknowns && m + 4 <= count; m += 4)
+    {
+        uint32_t matching = layers != nullptr ? DistanceLanes<float>::Matching(layers + m, layerMask) : 0xF;
+        if (matching == 0)
+        {
+            continue;
+        }
+
+        __m128 squared = zero;
+
+        for (uint32_t axis = 0; axis < Dim; axis++)
+        {
+            __m128i packed = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(quantized[axis] + m));
+            __m128i wide = _mm_unpacklo_epi16(packed, _mm_setzero_si128());
+            __m128 delta = _mm_add_ps(_mm_set1_ps(shift[axis]), _mm_mul_ps(_mm_cvtepi32_ps(wide), steps));
+            __m128 gap = _mm_max_ps(zero, _mm_sub_ps(_mm_and_ps(delta, absMask), _mm_set1_ps(slack[axis])));
+
+            squared = _mm_add_ps(squared, _mm_mul_ps(gap, gap));
+        }
+
+        for (uint32_t mask = static_cast<uint32_t>(_mm_movemask_ps(_mm_cmplt_ps(squared, limits))) & matching; mask != 0; mask &= mask - 1)
+        {
+            candidate(m + LowestSetBit(mask));
+        }
+    }
+#endif
+
+    // What is left after the vectorized loop, or everything if there is no vector instruction set.
+    for (; m < count; m++)
+    {
+        if (layers != nullptr && (layers[m] & layerMask) == 0)
+        {
+            continue;
+        }
+
+        float squared = 0.0f;
+
+        for (uint32_t axis = 0; axis < Dim; axis++)
+        {
+            const uint16_t value = quantized[axis][m];
+
+            if (unknowns && (value == 0 || value == 65535))
+            {
+                continue;
+            }
+
+            float delta = shift[axis] + value * step;
+
+            if (side != 0.0f)
+            {
+                delta -= side * std::nearbyint(delta / side);
+            }
+
+            float gap = std::max(0.0f, std::fabs(delta) - slack[axis]);
+            squared += gap * gap;
+        }
+
+        if (squared < limit)
+        {
+            candidate(m);
+        }
+    }
+}
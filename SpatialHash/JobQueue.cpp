@@ -0,0 +1,93 @@
+#include "pch.h"
+#include "JobQueue.h"
+
+using namespace std;
+
+JobQueue::JobQueue() : submitted(0), completed(0), stopping(false)
+{
+}
+
+JobQueue::~JobQueue()
+{
+    {
+        lock_guard<mutex> lock(stateMutex);
+        stopping = true;
+    }
+
+    jobAvailable.notify_all();
+
+    if (thread.joinable())
+    {
+        thread.join();
+    }
+}
+
+uint64_t JobQueue::Submit(function<void()> job)
+{
+    uint64_t ticket;
+
+    {
+        lock_guard<mutex> lock(stateMutex);
+
+        if (!thread.joinable())
+        {
+            thread = std::thread(&JobQueue::RunJobs, this);
+        }
+
+        jobs.push_back(move(job));
+        ticket = ++submitted;
+    }
+
+    jobAvailable.notify_one();
+
+    return ticket;
+}
+
+void JobQueue::Wait(uint64_t ticket)
+{
+    if (IsDone(ticket))
+    {
+        return;
+    }
+
+    unique_lock<mutex> lock(stateMutex);
+
+    // A ticket that was never given out would never be done.
+    if (ticket > submitted)
+    {
+        ticket = submitted;
+    }
+
+    jobDone.wait(lock, [&] { return IsDone(ticket); });
+}
+
+void JobQueue::RunJobs()
+{
+    while (true)
+    {
+        function<void()> job;
+
+        {
+            unique_lock<mutex> lock(stateMutex);
+            jobAvailable.wait(lock, [this] { return stopping || !jobs.empty(); });
+
+            // The jobs that are left are run even when stopping, someone may be waiting for them.
+            if (jobs.empty())
+            {
+                return;
+            }
+
+            job = move(jobs.front());
+            jobs.pop_front();
+        }
+
+        job();
+
+        {
+            lock_guard<mutex> lock(stateMutex);
+            completed.fetch_add(1, memory_order_release);
+        }
+
+        jobDone.notify_all();
+    }
+}
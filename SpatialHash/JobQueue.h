@@ -0,0 +1,60 @@
+#pragma once
+
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <cstdint>
+
+/// <summary>
+/// Runs jobs on a thread of its own, one at a time in the order they were submitted, so that the thread
+/// submitting them can do other things meanwhile. Every job gets a ticket, the tickets count up from 1,
+/// and a job is done once every job submitted before it is done too.
+/// The thread is started with the first job.
+/// </summary>
+class JobQueue
+{
+public:
+    JobQueue();
+
+    // Runs the jobs that are left before returning.
+    ~JobQueue();
+
+    /// <summary>
+    /// Adds a job to the end of the queue.
+    /// </summary>
+    /// <param name="job">Called once, from the thread of the queue.</param>
+    /// <returns>The ticket of the job.</returns>
+    uint64_t Submit(std::function<void()> job);
+
+    // True when the job with the ticket, and every job before it, is done.
+    bool IsDone(uint64_t ticket) const { return ticket <= completed.load(std::memory_order_acquire); }
+
+    /// <summary>
+    /// Waits until the job with the ticket, and every job before it, is done.
+    /// </summary>
+    /// <param name="ticket">From Submit().</param>
+    void Wait(uint64_t ticket);
+
+private:
+
+    std::thread thread;
+
+    // Protects the fields below and is used with the condition variables.
+    std::mutex stateMutex;
+    std::condition_variable jobAvailable;
+    std::condition_variable jobDone;
+
+    std::deque<std::function<void()>> jobs;
+
+    // The ticket of the last submitted job, and of the last job that is done.
+    uint64_t submitted;
+    std::atomic<uint64_t> completed;
+
+    bool stopping;
+
+    // What the thread does, runs jobs until the queue is stopped and empty.
+    void RunJobs();
+};
@@ -3,469 +3,4056 @@
 
 using namespace std;
 
-// Interop declarations.
-extern "C" __declspec(dllexport) void* Start(uint32_t tableSize);
-extern "C" __declspec(dllexport) void Init(uint32_t nrEntries, Entry * globalEntries, SpatialHash * spatialHash);
-extern "C" __declspec(dllexport) uint32_t Stop(SpatialHash * spatialHash);
-extern "C" __declspec(dllexport) CloseIdsAndNrOf GetEntries(int32_t nrOfPositions, Position* position, float d, int32_t maxEntities, SpatialHash * spatialHash);
-extern "C" __declspec(dllexport) void Update(SpatialHash * spatialHash);
-extern "C" __declspec(dllexport) void Remove(uint32_t nrOfEntriesToRemove, uint32_t * entryIndices, SpatialHash * spatialHash);
+// Compact cells quantize where an entry is in its cell, measured in cells, from quantizedLow to
+// quantizedLow + quantizedRange into 1 to quantizedOutside - 1, see Quantize().
+constexpr float quantizedLow = -0.5f;
+constexpr float quantizedRange = 2.0f;
+constexpr uint16_t quantizedOutside = 65535;
+constexpr float quantizedStep = quantizedRange / (quantizedOutside - 2);
 
 /// <summary>
-/// Proper modulo function.
+/// Mixes the full coordinates of a cell into a hash value, used by HashMode::Hashed.
+/// Multiplying by large odd constants spreads the bits upwards and the shifts bring them back down.
 /// </summary>
-inline int ProperMod(const uint32_t a, const int b)
+template<uint32_t Dim>
+inline uint32_t MixCell(const CellKey<Dim>& cell)
 {
-    return (a < 0 ? (((a % b) + b) % b) : (a % b));
+    constexpr uint64_t multipliers[3] = { 0x9E3779B97F4A7C15ull, 0xC2B2AE3D27D4EB4Full, 0x165667B19E3779F9ull };
+
+    uint64_t hash = 0;
+    for (uint32_t axis = 0; axis < Dim; axis++)
+    {
+        hash ^= static_cast<uint32_t>(cell[axis]) * multipliers[axis];
+    }
+
+    hash ^= hash >> 32;
+    hash *= 0xD6E8FEB86659FD93ull;
+    hash ^= hash >> 32;
+
+    return static_cast<uint32_t>(hash);
+}
+
+/// <summary>
+/// Calls visit with every combination of values along the Dim axes, the first axis changing fastest.
+/// </summary>
+/// <param name="values">The values every axis goes through.</param>
+/// <param name="visit">Called with every combination.</param>
+template<uint32_t Dim, typename Visit>
+inline void ForEachCombination(const vector<int32_t>& values, Visit&& visit)
+{
+    if (values.empty())
+    {
+        return;
+    }
+
+    CellKey<Dim> combination;
+    array<size_t, Dim> place{};
+    combination.fill(values[0]);
+
+    while (true)
+    {
+        visit(const_cast<const CellKey<Dim>&>(combination));
+
+        // Counts up like an odometer, the first axis first.
+        uint32_t axis = 0;
+        while (axis < Dim && ++place[axis] == values.size())
+        {
+            place[axis] = 0;
+            combination[axis] = values[0];
+            axis++;
+        }
+
+        if (axis == Dim)
+        {
+            return;
+        }
+
+        combination[axis] = values[place[axis]];
+    }
+}
+
+/// <summary>
+/// The whole numbers from low to high, for ForEachCombination().
+/// </summary>
+inline vector<int32_t> Range(int32_t low, int32_t high)
+{
+    vector<int32_t> values;
+    for (int32_t value = low; value <= high; value++)
+    {
+        values.push_back(value);
+    }
+
+    return values;
 }
 
 /// <summary>
-/// Euclidian distance.
+/// Calls visit once with every offset that is r cells away along the axis it is furthest away along,
+/// the ring of cells r cells around a cell. First the offsets at -r and r along the first axis, then
+/// along the second axis the ones not already visited, and so on.
 /// </summary>
-inline float Distance(const Position a, const Position b)
+/// <param name="r">How far away the ring is, at least 1.</param>
+/// <param name="visit">Called with every offset of the ring.</param>
+template<uint32_t Dim, typename Visit>
+inline void ForEachOnRing(int32_t r, Visit&& visit)
 {
-    return sqrt(pow(a.x - b.x, 2) + pow(a.y - b.y, 2));
+    for (uint32_t pinned = 0; pinned < Dim; pinned++)
+    {
+        // The axes before the pinned one stay inside of the ring, those offsets were visited with that axis pinned.
+        CellKey<Dim> low;
+        CellKey<Dim> high;
+        for (uint32_t axis = 0; axis < Dim; axis++)
+        {
+            low[axis] = axis < pinned ? 1 - r : -r;
+            high[axis] = axis < pinned ? r - 1 : r;
+        }
+
+        for (int32_t end : { -r, r })
+        {
+            CellKey<Dim> offset = low;
+            offset[pinned] = end;
+
+            while (true)
+            {
+                visit(const_cast<const CellKey<Dim>&>(offset));
+
+                // Counts up like an odometer, skipping the pinned axis.
+                uint32_t axis = 0;
+                while (axis < Dim && (axis == pinned || offset[axis] == high[axis]))
+                {
+                    if (axis != pinned)
+                    {
+                        offset[axis] = low[axis];
+                    }
+
+                    axis++;
+                }
+
+                if (axis == Dim)
+                {
+                    break;
+                }
+
+                offset[axis]++;
+            }
+        }
+    }
 }
 
 /// <summary>
-/// Creates a Spatial Hash of a certain size.
+/// Creates a Spatial Hash of a certain size, with cells as wide as the table is in cells.
 /// </summary>
 /// <param name="sideLength">The size of the Spatial Hash, needs to be a power of two.</param>
-SpatialHash::SpatialHash(size_t sidePower) : allEntries(allEntries), sideLength(pow(2, sidePower)), xMask(sideLength-1), yMask(sideLength-1)
+template<uint32_t Dim, typename Scalar>
+BasicSpatialHash<Dim, Scalar>::BasicSpatialHash(size_t sidePower) : BasicSpatialHash(sidePower, 0.0f)
+{
+}
+
+/// <summary>
+/// Creates a Spatial Hash of a certain size with a certain cell size.
+/// </summary>
+/// <param name="sidePower">The table is 2^sidePower cells along every dimension.</param>
+/// <param name="cellSize">The side length of a cell, 0 or less for cells as wide as the table is in cells.</param>
+template<uint32_t Dim, typename Scalar>
+BasicSpatialHash<Dim, Scalar>::BasicSpatialHash(size_t sidePower, float cellSize) : allEntries(allEntries), sideLength(pow(2, sidePower)), mask(sideLength-1)
 {
-    // Temporary value that will probably be determined at runtime later.
-    constexpr uint32_t reservedLocalEntries = 16;
+    invCellSize = cellSize > 0.0f ? 1 / static_cast<Scalar>(cellSize) : 1 / static_cast<Scalar>(sideLength);
+    autoTuneDistance = 0.0f;
+
+    hashMode = HashMode::Wrapped;
+    origin = PositionType();
 
-    invCellSize = 1 / (float)sideLength;
+    // Enough for searches up to one cell away, SetMaxSearchDistance() or larger searches increase it.
+    ringRadius = min(1, MaxRingRadius());
 
-    // table represents a two dimensional square.
+    // table represents a square, or a cube in 3d.
     table = new vector<Cell>();
-    table->resize(sideLength * sideLength);
+    table->resize(static_cast<size_t>(pow(sideLength, Dim)));
 
-    for (uint32_t i = 0; i != table->size(); i++)
-    {
-        table->at(i).localEntries = new vector<Entry>();
-        table->at(i).localEntries->reserve(reservedLocalEntries);
+    offsetArena = new vector<int32_t>();
+    stepLists = new vector<OffsetStep>();
+    stepMinSquaredDistances = new vector<float>();
 
-        table->at(i).offsets = new vector<vector<int32_t>*>();
+    // The entries are sorted into the cells with a counting sort, so every cell needs a start index.
+    cells = make_shared<CellStorageType>();
+    cells->cellStart.resize(table->size() + 1, 0);
+    cells->cellCount.resize(table->size(), 0);
+    cells->tags.resize(table->size(), Key{});
+    cells->mixed.resize(table->size(), 0);
+
+    // Searches read the same cells as updates write until double buffering is turned on.
+    publishedCells = cells;
+    doubleBuffered = false;
+
+    moverBuffers = new vector<vector<Mover>>();
+    movers = new vector<Mover>();
 
-        globalOffsets = new vector<vector<int32_t>*>();
-        globalOffsets->reserve(100);
-    }
-    
     closeEntries = new vector<IdWithDistance>();
     nrOfEntries = new vector<uint32_t>();
 
-    allEntered = new vector<Entered>();
+    workers = new WorkerPool(0);
+    jobQueue = new JobQueue();
+    queryBuffers = new vector<QueryBufferType>();
+    jobBuffers = new vector<QueryBufferType>();
+
+    searchOrder = new vector<uint64_t>();
+
+    closePairs = new vector<IdPair>();
+    pairBuffers = new vector<vector<IdPair>>();
+
+    allEntered = new vector<EnteredType>();
+    freeIds = new vector<uint32_t>();
+
+    statCounters = new StatCounters();
+
+    hysteresis = 0.0f;
+    hysteresisInCells = 0.0f;
     numberOfAllEntries = 0;
+    numberOfAttachedEntries = 0;
 }
 
-SpatialHash::~SpatialHash()
+template<uint32_t Dim, typename Scalar>
+BasicSpatialHash<Dim, Scalar>::~BasicSpatialHash()
 {
-    for (uint32_t i = 0; i != globalOffsets->size(); i++)
-    {
-        delete globalOffsets->at(i);
-    }
-
-    delete globalOffsets;
+    // The jobs that are left use everything else, so they are run first.
+    delete jobQueue;
 
-    for (size_t i = 0; i != table->size(); i++)
-    {
-        delete table->at(i).localEntries;
-        delete table->at(i).offsets;
-    }
+    delete offsetArena;
+    delete stepLists;
+    delete stepMinSquaredDistances;
 
     delete table;
 
+    delete moverBuffers;
+    delete movers;
+
     delete closeEntries;
+
+    delete workers;
+    delete queryBuffers;
+    delete jobBuffers;
+
+    delete searchOrder;
+
+    delete closePairs;
+    delete pairBuffers;
+
+    delete allEntered;
+    delete freeIds;
+
+    delete statCounters;
 }
 
 /// <summary>
 /// Inserts all the entries in allEntries into the hash table.
 /// </summary>
-void SpatialHash::Initilize(Entry* inAllEntries, uint32_t numberOfEntries)
+template<uint32_t Dim, typename Scalar>
+void BasicSpatialHash<Dim, Scalar>::Initilize(EntryType* inAllEntries, uint32_t numberOfEntries)
 {
+    // Auto tuning resizes the cells, so they are taken before that.
+    BeginCellsUpdate();
+
+    // The new cells start with offsets that reach the tuned for distance, longer searches extend them.
+    if (autoTuneDistance > 0.0f && numberOfEntries != 0)
+    {
+        AutoTune(inAllEntries, numberOfEntries);
+        ExtendRings(autoTuneDistance);
+    }
+
     InitializeOffsets();
 
     allEntries = inAllEntries;
 
     numberOfAllEntries = numberOfEntries;
+    numberOfAttachedEntries = numberOfEntries;
 
     allEntered->resize(numberOfAllEntries);
+    freeIds->clear();
 
     for (uint32_t i = 0; i < numberOfAllEntries; i++)
     {
-        allEntered->at(i) = InsertInTable(&allEntries[i]);
+        allEntered->at(i) = EnteredType(allEntries[i], 0, CalculateCellNr(allEntries[i].position));
     }
-}
 
-/// <summary>
-/// Checks if any entry in allEntries have moved to another cell,
-/// in which case it inserts them into that cell and removes them
-/// from their old one.
-/// </summary>
-void SpatialHash::UpdateTable()
-{
-    for (uint32_t i = 0; i < numberOfAllEntries; i++)
-    {
-        allEntered->at(i).entry = allEntries[i];
-        UpdateEntered(&allEntered->at(i));
-    }
+    RebuildCells();
+    PublishCells();
 }
 
 /// <summary>
-/// Checks if inputed entry have moved to a new cell. If it has
-/// moved, it is reinserted and the old one is removed.
+/// Updates the table in two phases. In the first the entries are rehashed in parallel, entries that
+/// are still in the same cell get their position updated in place and the ones that have moved
+/// are collected. In the second the movers are moved between cells in batches, unless so many
+/// moved that sorting all the entries again with RebuildCells() is cheaper.
 /// </summary>
-/// <param name="entered">Entry will be put into correct cell.</param>
-void SpatialHash::UpdateEntered(Entered* entered)
+template<uint32_t Dim, typename Scalar>
+void BasicSpatialHash<Dim, Scalar>::UpdateTable()
 {
-    uint32_t currenthashValue = CalculateCellNr(entered->entry.position);
-    if (currenthashValue != entered->hashValue)
-    {
-        RemoveEntryFromCell(entered);
-        allEntered->at(entered->entry.id) = InsertInTable(&entered->entry, currenthashValue);
-    }
-    else
-    {
-        table->at(entered->hashValue).localEntries->at(entered->nrInCell) = entered->entry;
-    }
-}
+    // Below this many entries per thread it's not worth waking up the other threads.
+    constexpr uint32_t minEntriesPerPart = 4096;
 
-void SpatialHash::RemoveEntryFromTable(uint32_t entryIndex)
-{
-}
+    SPATIALHASH_COUNT(PhaseTimer timer(*statCounters, Phase::Update); statCounters->updates++;)
 
-void SpatialHash::RemoveEntryFromTableBulk(uint32_t nrOfEntriesToRemove, uint32_t* entryIndices)
-{
-    for (uint32_t i = 0; i < nrOfEntriesToRemove; i++)
+    // If more than 1 / rebuildFraction of the entries moved, all of them are sorted again.
+    constexpr uint32_t rebuildFraction = 8;
+
+    // Entries inserted with ids outside of allEntries aren't updated from it.
+    const uint32_t numberToUpdate = min(numberOfAttachedEntries, numberOfAllEntries);
+
+    uint32_t nrOfParts = max(1u, min(workers->NrOfWorkers(), numberToUpdate / minEntriesPerPart));
+
+    if (moverBuffers->size() < nrOfParts)
     {
-        RemoveEntryFromTable(entryIndices[i]);
+        moverBuffers->resize(nrOfParts);
     }
-}
 
-/// <summary>
-/// Removes input entry from hash table.
-/// </summary>
-/// <param name="entered">Entry to remove from its current cell.</param>
-void SpatialHash::RemoveEntryFromCell(Entered* entered)
-{
-    // If the entry is at the end of the vector it can be removed straight away.
-    if (entered->nrInCell == table->at(entered->hashValue).localEntries->size())
+    BeginCellsUpdate();
+
+    workers->Run(nrOfParts, [&](uint32_t part)
     {
-        table->at(entered->hashValue).localEntries->pop_back();
-    }
-    else
+        vector<Mover>& partMovers = (*moverBuffers)[part];
+        partMovers.clear();
+
+        uint32_t from = static_cast<uint32_t>(static_cast<uint64_t>(numberToUpdate) * part / nrOfParts);
+        uint32_t to = static_cast<uint32_t>(static_cast<uint64_t>(numberToUpdate) * (part + 1) / nrOfParts);
+
+        for (uint32_t i = from; i < to; i++)
+        {
+            EnteredType& entered = (*allEntered)[i];
+
+            if (entered.hashValue == removedHashValue)
+            {
+                continue;
+            }
+
+            const PositionType previous = entered.entry.position;
+            entered.entry = allEntries[i];
+
+            uint32_t currentHashValue = CalculateCellNr(entered.entry.position, entered.hashValue);
+
+            if (currentHashValue == entered.hashValue && StaysInCell(previous, entered.entry.position, entered.hashValue))
+            {
+                // Only this entry is ever written to its place, so this is safe to do in parallel.
+                StorePosition(cells->cellStart[entered.hashValue] + entered.nrInCell, entered.hashValue, entered.entry.position);
+            }
+            else
+            {
+                partMovers.push_back(Mover{ i, entered.hashValue, currentHashValue });
+                entered.hashValue = currentHashValue;
+            }
+        }
+    });
+
+    movers->clear();
+    for (uint32_t part = 0; part < nrOfParts; part++)
     {
-        // If the entry isn't at the end of the vector, it's overwritten with the entry that is.
-        allEntered->at(table->at(entered->hashValue).localEntries->back().id).nrInCell = entered->nrInCell;
-        table->at(entered->hashValue).localEntries->at(entered->nrInCell) = table->at(entered->hashValue).localEntries->back();
-        table->at(entered->hashValue).localEntries->pop_back();
+        movers->insert(movers->end(), (*moverBuffers)[part].begin(), (*moverBuffers)[part].end());
     }
-}
 
-/// <summary>
-/// Inserts an entry into the spatial hash table.
-/// </summary>
-/// <param name="entry">Entry to insert.</param>
-/// <returns>The entry with the information of where in the hash table it is.</returns>
-Entered SpatialHash::InsertInTable(Entry* entry)
-{
-    uint32_t cellNr = CalculateCellNr(entry->position);
-    return SpatialHash::InsertInTable(entry, cellNr);
-}
-Entered SpatialHash::InsertInTable(Entry* entry, uint32_t cellNr)
-{
-    this->table->at(cellNr).localEntries->push_back(*entry);
+    if (!movers->empty())
+    {
+        SPATIALHASH_COUNT(statCounters->migrations += movers->size();)
 
-    return Entered(*entry, this->table->at(cellNr).localEntries->size()-1, cellNr);
-}
+        if (movers->size() > numberOfAllEntries / rebuildFraction)
+        {
+            RebuildCells();
+        }
+        else
+        {
+            MoveEntries();
+        }
+    }
 
-/// <summary>
-/// The hashing function. Calculates where in the spatial hash a position ends up.
-/// </summary>
-/// <param name="pos">The position to find a cell for.</param>
-/// <returns>The cell number associated with the input position.</returns>
-uint32_t SpatialHash::CalculateCellNr(Position pos)
-{
-    return CalculateCellNr(pos.x, pos.y);
+    PublishCells();
 }
 
 /// <summary>
-/// The hashing function. Calculates where in the spatial hash a position ends up.
+/// Gives a number of entries new positions, without looking at any of the other entries. The positions are
+/// written into the hash table, and into allEntries for ids inside of it so the next UpdateTable() agrees.
+/// Entries that change cell are moved right away. If a cell runs out of room the rest only get new hash values
+/// and all the entries are sorted into their cells again in the end.
 /// </summary>
-/// <param name="x">Horizontal position to find a cell for.</param>
-/// <param name="y">Vertical position to find a cell for.</param>
-/// <returns>The cell number associated with the input position.</returns>
-uint32_t SpatialHash::CalculateCellNr(float x, float y)
+/// <param name="nrOfEntriesToUpdate">Number of entries that have moved.</param>
+/// <param name="ids">Ids of the entries, ids that aren't in use are ignored.</param>
+/// <param name="positions">The new positions of the entries.</param>
+template<uint32_t Dim, typename Scalar>
+void BasicSpatialHash<Dim, Scalar>::UpdateEntriesBulk(uint32_t nrOfEntriesToUpdate, const uint32_t* ids, const PositionType* positions)
 {
-    // Calculate where in the theoretical 2d hash table the entry would end up.
-    float tx = x * invCellSize;
-    float ty = y * invCellSize;
-    
-    uint32_t xCellNr = static_cast<uint32_t>(tx) & xMask;
-    uint32_t yCellNr = static_cast<uint32_t>(ty) & yMask;
+    SPATIALHASH_COUNT(PhaseTimer timer(*statCounters, Phase::Update); statCounters->updates++;)
 
-    // Convert this to the actual cell in the vector.
-    return xCellNr + yCellNr * sideLength;
-}
+    BeginCellsUpdate();
 
-/// <summary>
-/// Gets all entities in the spatial hash that are within a certain distance of a position.
-/// </summary>
-/// <param name="pos">Where to search for entities.</param>
-/// <param name="d">The radius of the search area.</param>
-/// <param name="maxEntities">The max number of entities to return.</param>
-void SpatialHash::GetCloseEntries(Position pos, float d, int32_t maxEntities)
-{
-    // This is the cell that will be the origo of the search.
-    uint32_t cellNr = CalculateCellNr(pos);
+    bool rebuild = false;
 
-    /* Loops through the different steps. If you find enough close entities
-    in a step, you can end the loop and return since there can be no other closer
-    entites. */
-    for (uint32_t i = 0; i < table->at(cellNr).offsets->size() ; i++)
+    for (uint32_t i = 0; i < nrOfEntriesToUpdate; i++)
     {
-        int32_t currentStart = closeEntries->size();
+        const uint32_t id = ids[i];
 
-        // Loops through all the offsets that belong to the current step.
-        for (uint32_t j = 0; j < table->at(cellNr).offsets->at(i)->size(); j++)
+        if (id >= numberOfAllEntries || (*allEntered)[id].hashValue == removedHashValue)
         {
-            uint32_t offsetCell = cellNr + table->at(cellNr).offsets->at(i)->at(j);
+            continue;
+        }
 
-            GetCloseEntriesInCell(offsetCell, pos, d);
+        EnteredType& entered = (*allEntered)[id];
+        const PositionType previous = entered.entry.position;
+        entered.entry.position = positions[i];
+
+        if (id < numberOfAttachedEntries)
+        {
+            allEntries[id].position = positions[i];
         }
 
-        // If there are too many entries only the closest should be kept so they need to be orderd.
-        SortCloseEntries(currentStart);
+        uint32_t currentHashValue = CalculateCellNr(positions[i], entered.hashValue);
 
-        // If there's enough elements the function can return.
-        if (closeEntries->size() >= maxEntities)
+        if (currentHashValue != entered.hashValue)
         {
-            closeEntries->resize(maxEntities);
-            nrOfEntries->push_back(static_cast<uint32_t>(closeEntries->size()));
-            return;
+            SPATIALHASH_COUNT(statCounters->migrations++;)
+        }
+
+        if (rebuild)
+        {
+            entered.hashValue = currentHashValue;
+        }
+        else if (currentHashValue == entered.hashValue && StaysInCell(previous, positions[i], entered.hashValue))
+        {
+            StorePosition(cells->cellStart[entered.hashValue] + entered.nrInCell, entered.hashValue, positions[i]);
+        }
+        else
+        {
+            RemoveFromCell(id, entered.hashValue);
+            entered.hashValue = currentHashValue;
+
+            rebuild = !AddToCell(id, currentHashValue);
         }
     }
 
-    nrOfEntries->push_back(static_cast<uint32_t>(closeEntries->size()));
+    if (rebuild)
+    {
+        RebuildCells();
+    }
 
-    return;
+    PublishCells();
 }
 
 /// <summary>
-/// Gets all the entries in a cell of the hash table that are within a distance, d, of a position, pos.
+/// Sets how far outside of its cell an entry can move before it's moved to another cell. Entries that
+/// jitter on the border between two cells then stay in one of them, at the cost of searches having to
+/// look a bit further. When the hysteresis shrinks some entries may be too far outside of their cells,
+/// so then all entries are sorted into the cells they are in.
 /// </summary>
-/// <param name="cellIndex">Cell to look for close entries in.</param>
-/// <param name="pos">Position to look for close entries around.</param>
-/// <param name="d">The distance inside of which entries are considered close.</param>
-inline void SpatialHash::GetCloseEntriesInCell(uint32_t cellIndex, Position pos, float d)
+/// <param name="margin">The distance, less than half a cell.</param>
+template<uint32_t Dim, typename Scalar>
+void BasicSpatialHash<Dim, Scalar>::SetHysteresis(float margin)
 {
-    float tempDistance = 0;
-    Entry tempEntry;
-    IdWithDistance tempIdWithDistance;
+    // With less than half a cell the margins around a position only reach two cells along a side.
+    margin = min(max(0.0f, margin), 0.49f * CellSize());
+
+    if (hashMode == HashMode::Hashed)
+    {
+        margin = 0.0f;
+    }
+
+    bool shrinks = margin < hysteresis;
 
-    for (size_t m = 0; m < table->at(cellIndex).localEntries->size(); m++)
+    hysteresis = margin;
+    hysteresisInCells = margin * static_cast<float>(invCellSize);
+
+    if (shrinks && numberOfAllEntries != 0)
     {
-        tempDistance = Distance(table->at(cellIndex).localEntries->at(m).position, pos);
+        BeginCellsUpdate();
 
-        /* Imporant because entites sharing cells can still be very far from each other because
-         * of the hashing/modulo on insertion. */
-        if (tempDistance < d)
+        for (uint32_t i = 0; i < numberOfAllEntries; i++)
         {
-            tempEntry = table->at(cellIndex).localEntries->at(m);
-            tempIdWithDistance = IdWithDistance(tempEntry.id, tempDistance);
+            EnteredType& entered = (*allEntered)[i];
 
-            closeEntries->push_back(tempIdWithDistance);
+            if (entered.hashValue != removedHashValue)
+            {
+                entered.hashValue = CalculateCellNr(entered.entry.position);
+            }
         }
+
+        RebuildCells();
+        PublishCells();
     }
 }
 
 /// <summary>
-/// Sorts the elements of closeEntries which is needed for GetCloseEntries
-/// to be able to tell which elements are the closests.
+/// Moves the entries in movers to their new cells. First all of them are removed from their old cells,
+/// grouped by cell, and then they are added to their new cells, grouped by cell. If a cell doesn't have
+/// room for all the entries moving into it, all the entries are sorted into their cells again instead.
 /// </summary>
-/// <param name="from">From which index to sort the list.</param>
-inline void SpatialHash::SortCloseEntries(int32_t from)
+template<uint32_t Dim, typename Scalar>
+void BasicSpatialHash<Dim, Scalar>::MoveEntries()
 {
-    /* Insert-sort the vector. The whole point of the Spatial Hash is that there should only be
-     * a small number of elements in this list so using Insert Sort probably makes sense.
-     * This should be tested sometime though. */
-    for (int32_t h = from; h < static_cast<int>(closeEntries->size()); h++)
+    vector<uint32_t>& cellStart = cells->cellStart;
+    vector<uint32_t>& cellCount = cells->cellCount;
+
+    sort(movers->begin(), movers->end(), [](const Mover& a, const Mover& b) { return a.fromCell < b.fromCell; });
+
+    for (size_t i = 0; i != movers->size(); i++)
     {
-        IdWithDistance tempEntry = closeEntries->at(h);
+        RemoveFromCell((*movers)[i].id, (*movers)[i].fromCell);
+    }
+
+    sort(movers->begin(), movers->end(), [](const Mover& a, const Mover& b) { return a.toCell < b.toCell; });
+
+    // Every cell that is moved into must have room for all of its new entries.
+    for (size_t i = 0; i != movers->size();)
+    {
+        uint32_t toCell = (*movers)[i].toCell;
 
-        int32_t k = h - 1;
-        while (k >= from && closeEntries->at(k).distance > tempEntry.distance)
+        size_t groupEnd = i;
+        while (groupEnd != movers->size() && (*movers)[groupEnd].toCell == toCell)
         {
-            closeEntries->at(k + 1) = closeEntries->at(k);
-            k--;
+            groupEnd++;
+        }
+
+        if (cellCount[toCell] + (groupEnd - i) > cellStart[toCell + 1] - cellStart[toCell])
+        {
+            RebuildCells();
+            return;
         }
 
-        closeEntries->at(k + 1) = tempEntry;
+        i = groupEnd;
+    }
+
+    for (size_t i = 0; i != movers->size(); i++)
+    {
+        AddToCell((*movers)[i].id, (*movers)[i].toCell);
     }
 }
 
 /// <summary>
-/// For more efficent interoping GetCloseEntries requests are bunched together.
+/// Removes an entry from a cell by moving the last entry of the cell to where it was.
 /// </summary>
-/// <param name="nrSearches">How many GetCloseEntries requests that are bunched together.</param>
-/// <param name="pos">An array of postions, nrSearches long.</param>
-/// <param name="d">Distance in which entries are considered close.</param>
-/// <param name="maxEntities">Max number of entries per GetCloseEntries to return.</param>
-/// <returns>The entries that are close to the positions and how many of them there are.</returns>
-CloseIdsAndNrOf SpatialHash::GetCloseEntriesBulk(int32_t nrSearches, Position* pos, float d, int32_t maxEntities)
+/// <param name="id">The entry to remove.</param>
+/// <param name="cellNr">The cell the entry is in.</param>
+template<uint32_t Dim, typename Scalar>
+void BasicSpatialHash<Dim, Scalar>::RemoveFromCell(uint32_t id, uint32_t cellNr)
 {
-    // Since new entries to return is to be calculated we need to get rid of the old ones.
-    closeEntries->clear();
-    closeEntries->reserve(nrSearches*maxEntities);
+    const uint32_t start = cells->cellStart[cellNr];
 
-    nrOfEntries->clear();
-    nrOfEntries->reserve(nrSearches);
+    uint32_t place = start + (*allEntered)[id].nrInCell;
+    uint32_t last = start + --cells->cellCount[cellNr];
 
-    for (int32_t i = 0; i < nrSearches; i++)
+    cells->ids[place] = cells->ids[last];
+    for (uint32_t axis = 0; axis < Dim; axis++)
+    {
+        if (cells->compact)
+        {
+            cells->quantized[axis][place] = cells->quantized[axis][last];
+        }
+        else
+        {
+            cells->coordinates[axis][place] = cells->coordinates[axis][last];
+        }
+    }
+    if (cells->layered)
     {
-        // Max entities for GetCloseEntries have to take into account previously added entries.
-        SpatialHash::GetCloseEntries(pos[i], d, maxEntities + closeEntries->size());
+        cells->layers[place] = cells->layers[last];
     }
+    (*allEntered)[cells->ids[place]].nrInCell = place - start;
 
-    if (nrSearches == 0)
+    // An empty bucket is no longer mixed, its tag is set by the next entry.
+    if (cells->cellCount[cellNr] == 0)
     {
-        nrOfEntries->push_back(0);
+        cells->mixed[cellNr] = 0;
     }
-
-    return CloseIdsAndNrOf{ nrOfEntries->data(), closeEntries->data() };
 }
 
 /// <summary>
-/// Calculates all the different localized offsets from unlocalized offsets read from a file.
-/// These are then stored in globalOffsets.
+/// Adds an entry to the end of a cell, if the cell has room for it.
 /// </summary>
-void SpatialHash::InitializeOffsets()
+/// <param name="id">The entry to add, its position is taken from allEntered.</param>
+/// <param name="cellNr">The cell to add it to.</param>
+/// <returns>False if the cell was full and the entry wasn't added.</returns>
+template<uint32_t Dim, typename Scalar>
+bool BasicSpatialHash<Dim, Scalar>::AddToCell(uint32_t id, uint32_t cellNr)
 {
-    ReadOffsetsFromFile();
+    uint32_t& count = cells->cellCount[cellNr];
+    uint32_t place = cells->cellStart[cellNr] + count;
 
-    for (int32_t y = 0; y != sideLength; y++)
+    if (place == cells->cellStart[cellNr + 1])
     {
-        for (int32_t x = 0; x != sideLength; x++)
-        {
-            InitializeOffsetsInCell(x, y);
-        }
+        return false;
+    }
+
+    EnteredType& entered = (*allEntered)[id];
+
+    if (hashMode == HashMode::Hashed || cells->compact)
+    {
+        TagCell(cellNr, count, entered.entry.position);
+    }
+
+    cells->ids[place] = id;
+    StorePosition(place, cellNr, entered.entry.position);
+    if (cells->layered)
+    {
+        cells->layers[place] = entered.layers;
     }
+    entered.nrInCell = count++;
+
+    return true;
 }
 
 /// <summary>
-/// Calculates all the different offsets of a cell and points them to their
-/// representation in globalOffsets or if the isn't in there puts it there.
+/// Writes the coordinates of a position to a place in the cell storage, one array per axis.
+/// Compact cells get where the position is in the cell instead, see Quantize().
 /// </summary>
-/// <param name="x"></param>
-/// <param name="y"></param>
-void SpatialHash::InitializeOffsetsInCell(uint32_t x, uint32_t y)
+/// <param name="place">The place in the cell storage.</param>
+/// <param name="cellNr">The cell the place belongs to.</param>
+/// <param name="pos">The position.</param>
+template<uint32_t Dim, typename Scalar>
+inline void BasicSpatialHash<Dim, Scalar>::StorePosition(uint32_t place, uint32_t cellNr, const PositionType& pos)
 {
-    uint32_t i = x + y * sideLength;
-
-    vector<int32_t>* cellOffsets;
-
-    // Loop through all the steps.
-    for (uint32_t k = 0; k < xOffsetsToCalculate.size(); k++)
+    if (!cells->compact)
     {
-        cellOffsets = new vector<int32_t>();
-
-        // Loop through all the offsets of the current step.
-        for (uint32_t j = 0; j < xOffsetsToCalculate[k].size(); j++)
+        for (uint32_t axis = 0; axis < Dim; axis++)
         {
-            // Offsets are calculated from the unlocalized offsets.
-            int32_t tx = x + xOffsetsToCalculate[k][j];
-            int32_t ty = y + yOffsetsToCalculate[k][j];
-            tx = ProperMod(tx, sideLength);
-            ty = ProperMod(ty, sideLength);
-
-            cellOffsets->push_back((tx + ty * sideLength) - i);
+            cells->coordinates[axis][place] = pos[axis];
         }
 
-        bool found = false;
+        return;
+    }
 
-        // Loop through all the offsets in global offsets and check if the offset already exist.
-        for (uint32_t j = 0; j < globalOffsets->size(); j++)
-        {
-            if (*globalOffsets->at(j) == *cellOffsets)
-            {
-                delete cellOffsets;
-                table->at(i).offsets->push_back(globalOffsets->at(j));
-                found = true;
-                break;
-            }
-        }
+    const Key cell = QuantizedCell(pos, cellNr);
 
-        if (!found)
-        {
-            globalOffsets->push_back(cellOffsets);
-            table->at(i).offsets->push_back(cellOffsets);
-        }
+    for (uint32_t axis = 0; axis < Dim; axis++)
+    {
+        cells->quantized[axis][place] = Quantize(axis, pos[axis], cell[axis]);
     }
 }
 
 /// <summary>
-/// The unlocalized offsets are calculated in another program and saved as a file since they don't need to be calculated more than once.
+/// The cell of the world that an entry in a cell of the table is from. With hysteresis that isn't always the cell its
+/// position is in, but the one of the cells of the world that end up in the cell of the table it is closest to.
+/// In a bounded table that is the cell of the table, also for entries outside of the table.
 /// </summary>
-void SpatialHash::ReadOffsetsFromFile()
+/// <param name="pos">The position of the entry.</param>
+/// <param name="cellNr">The cell of the table the entry is in.</param>
+/// <returns>The coordinates of the cell.</returns>
+template<uint32_t Dim, typename Scalar>
+inline CellKey<Dim> BasicSpatialHash<Dim, Scalar>::QuantizedCell(const PositionType& pos, uint32_t cellNr) const
 {
-    // The offsets are calculated before runtime and saved in a file that is loaded here.
-    ifstream offsetsFile;
-    offsetsFile.open("F:\\Prog\\Repos\\SpaceFiller\\bin\\Debug\\netcoreapp3.1\\Offsets.abi", ios::in | ios::binary);
-
-    if (offsetsFile.is_open())
+    if (hashMode == HashMode::Hashed)
     {
-        uint32_t numberOfSteps = 0;
-
-        vector<int32_t> xOffsets;
-        vector<int32_t> yOffsets;
+        return CellCoordinates(pos);
+    }
 
-        offsetsFile.read((char*)&numberOfSteps, sizeof(numberOfSteps));
+    Key cell = TableCoordinates(cellNr);
 
-        for (uint32_t i = 0; i < numberOfSteps; i++)
+    if (hashMode == HashMode::Wrapped)
+    {
+        for (uint32_t axis = 0; axis < Dim; axis++)
         {
-            int32_t stepSize = 0;
-            offsetsFile.read((char*)&stepSize, sizeof(stepSize));
-            
-            xOffsets.clear();
-            yOffsets.clear();
-
-            for (uint32_t j = 0; j < stepSize; j++)
-            {
-                uint32_t x = 0;
-                offsetsFile.read((char*)&x, sizeof(x));
-                xOffsets.push_back(x);
-
-                uint32_t y = 0;
-                offsetsFile.read((char*)&y, sizeof(y));
-                yOffsets.push_back(y);
-            }
-
-            xOffsetsToCalculate.push_back(xOffsets);
-            yOffsetsToCalculate.push_back(yOffsets);
+            double t = (static_cast<double>(pos[axis]) - origin[axis]) * invCellSize - cell[axis];
+            cell[axis] += static_cast<int32_t>(sideLength * floor((t - quantizedLow) / sideLength));
         }
-
-        offsetsFile.close();
     }
-}
 
-/*-------------INTEROPS------------*/
+    return cell;
+}
 
 /// <summary>
-/// Instanciates a SpatialHash of a certain size.
+/// Where along an axis a coordinate is, measured in cells from the corner of a cell, in 16 bits. 1 to 65534 are
+/// quantizedLow cells up to quantizedLow + quantizedRange cells, which is the cell with the hysteresis around it.
+/// 0 and 65535 are below and above that, which only entries outside of a bounded table can be.
 /// </summary>
-/// <param name="tableSize">The length and height of the table will be 2^tableSize.</param>
-/// <returns>A pointer to the instanciated SpatialHash.</returns>
-void* Start(uint32_t tableSize)
+/// <param name="axis">The axis.</param>
+/// <param name="coordinate">The coordinate along the axis.</param>
+/// <param name="cell">The coordinate of the cell along the axis.</param>
+/// <returns>The quantized coordinate.</returns>
+template<uint32_t Dim, typename Scalar>
+inline uint16_t BasicSpatialHash<Dim, Scalar>::Quantize(uint32_t axis, Scalar coordinate, int32_t cell) const
 {
-    SpatialHash* spatialHash = new SpatialHash(tableSize);
+    double t = (static_cast<double>(coordinate) - origin[axis]) * invCellSize - cell;
 
-    return spatialHash;
+    if (t < quantizedLow)
+    {
+        return 0;
+    }
+
+    if (t > quantizedLow + quantizedRange)
+    {
+        return quantizedOutside;
+    }
+
+    return static_cast<uint16_t>(1 + lround((t - quantizedLow) / quantizedStep));
 }
 
 /// <summary>
-/// Loads the SpatialHash with the start number of entries via an array of entries.
+/// Finds the entries from a place in the cell storage that are closer to query than the square root of dSquared, like
+/// FindWithinDistance(). Compact cells first tell, from the quantized positions, how close the entries can be. The error
+/// of the quantization and of the float math is taken away from that, so entries that are close are never missed.
+/// Entries that are close even with the error added are hits, with their quantized distance. Only the ones in between,
+/// and those of mixed cells which could be from other cells of the world, are tested with their positions from allEntered.
+/// Entries in none of the layers of layerMask are passed over before any of that.
+/// </summary>
+/// <param name="storage">The generation of the cells.</param>
+/// <param name="cellIndex">The cell the entries are in.</param>
+/// <param name="place">The place in the cell storage of the first entry, in the cell.</param>
+/// <param name="count">The number of entries.</param>
+/// <param name="query">The position to measure from, Dim coordinates.</param>
+/// <param name="dSquared">The square of the distance inside of which entries are close.</param>
+/// <param name="layerMask">The layers entries have to be in, allLayers for every entry.</param>
+/// <param name="hit">Called with the index, from place, and squared distance of every close entry, in order.</param>
+template<uint32_t Dim, typename Scalar>
+template<typename Hit>
+inline void BasicSpatialHash<Dim, Scalar>::FindStoredWithinDistance(const CellStorageType& storage, uint32_t cellIndex, uint32_t place, uint32_t count, const Scalar* query, Scalar dSquared, uint32_t layerMask, Hit&& hit) const
+{
+    if (layerMask == 0)
+    {
+        return;
+    }
+
+    // Without masks in the cells every entry is in every layer.
+    const uint32_t* layers = storage.layered && layerMask != allLayers ? storage.layers.data() + place : nullptr;
+
+    if (!storage.compact)
+    {
+        const Scalar* axes[Dim];
+        for (uint32_t axis = 0; axis < Dim; axis++)
+        {
+            axes[axis] = storage.coordinates[axis].data() + place;
+        }
+
+        FindWithinDistance<Dim>(axes, count, query, dSquared, layers, layerMask, hit);
+        return;
+    }
+
+    if (count == 0)
+    {
+        return;
+    }
+
+    const uint32_t* ids = storage.ids.data() + place;
+
+    // Tests an entry with its position from allEntered.
+    auto Refine = [&](uint32_t m)
+    {
+        const PositionType& pos = (*allEntered)[ids[m]].entry.position;
+
+        Scalar squared = 0;
+        for (uint32_t axis = 0; axis < Dim; axis++)
+        {
+            Scalar delta = pos[axis] - query[axis];
+            squared += delta * delta;
+        }
+
+        if (squared < dSquared)
+        {
+            hit(m, static_cast<float>(squared));
+        }
+    };
+
+    const bool mixed = storage.mixed[cellIndex] != 0;
+
+    // The entries of a mixed bucket can be from anywhere.
+    if (mixed && hashMode == HashMode::Hashed)
+    {
+        for (uint32_t m = 0; m < count; m++)
+        {
+            if (layers == nullptr || (layers[m] & layerMask) != 0)
+            {
+                Refine(m);
+            }
+        }
+
+        return;
+    }
+
+    /* The entries of a mixed cell of a wrapped table are from cells of the world a number of tables apart, so the
+    closest of those cells is measured to. Only if that can be more than half a table away does every entry need to be
+    moved to its closest cell. Along every axis an entry is shift + quantized * quantizedStep cells from the query.
+    Entries outside of a bounded table are in the cells at its edge, only they can be outside of the quantized range. */
+    const Key cell = mixed ? TableCoordinates(cellIndex) : storage.tags[cellIndex];
+    float shift[Dim];
+    float slack[Dim];
+    float side = 0.0f;
+    bool unknowns = false;
+
+    for (uint32_t axis = 0; axis < Dim; axis++)
+    {
+        double c = cell[axis] + quantizedLow - (static_cast<double>(query[axis]) - origin[axis]) * invCellSize;
+
+        if (mixed)
+        {
+            c -= sideLength * floor(c / sideLength + 0.5);
+
+            if (2 * (c + quantizedRange) > sideLength)
+            {
+                side = static_cast<float>(sideLength);
+            }
+        }
+
+        if (hashMode == HashMode::Bounded && (cell[axis] == 0 || cell[axis] == static_cast<int32_t>(sideLength) - 1))
+        {
+            unknowns = true;
+        }
+
+        shift[axis] = static_cast<float>(c) - quantizedStep;
+        slack[axis] = 0.5f * quantizedStep + 8 * numeric_limits<float>::epsilon() * (fabsf(shift[axis]) + quantizedRange + 1);
+    }
+
+    // A little more and a little less, for the rounding of the squares and sums.
+    const float squaredCellSize = static_cast<float>(1 / (invCellSize * invCellSize));
+    const float limitInCells = static_cast<float>(dSquared * invCellSize * invCellSize);
+    const float canBeClose = limitInCells * (1.0f + 1e-5f);
+    const float isClose = limitInCells * (1.0f - 1e-5f);
+
+    const uint16_t* quantized[Dim];
+    for (uint32_t axis = 0; axis < Dim; axis++)
+    {
+        quantized[axis] = storage.quantized[axis].data() + place;
+    }
+
+    FindQuantizedWithinDistance<Dim>(quantized, count, shift, slack, quantizedStep, canBeClose, side, unknowns, layers, layerMask,
+        [&](uint32_t m)
+    {
+        if (!mixed)
+        {
+            float squared = 0.0f;
+            float furthest = 0.0f;
+            bool known = true;
+
+            for (uint32_t axis = 0; axis < Dim; axis++)
+            {
+                known = known && quantized[axis][m] != 0 && quantized[axis][m] != quantizedOutside;
+
+                float delta = fabsf(shift[axis] + quantized[axis][m] * quantizedStep);
+                squared += delta * delta;
+                furthest += (delta + slack[axis]) * (delta + slack[axis]);
+            }
+
+            if (known && furthest < isClose)
+            {
+                hit(m, squared * squaredCellSize);
+                return;
+            }
+        }
+
+        Refine(m);
+    });
+}
+
+/// <summary>
+/// The position of the entry at a place in the cell storage. Compact cells don't have it, then it's from allEntered.
+/// </summary>
+/// <param name="storage">The generation of the cells.</param>
+/// <param name="place">The place in the cell storage.</param>
+/// <param name="coordinates">Gets the coordinate along every axis.</param>
+template<uint32_t Dim, typename Scalar>
+inline void BasicSpatialHash<Dim, Scalar>::StoredPosition(const CellStorageType& storage, uint32_t place, Scalar (&coordinates)[Dim]) const
+{
+    for (uint32_t axis = 0; axis < Dim; axis++)
+    {
+        coordinates[axis] = storage.compact ? (*allEntered)[storage.ids[place]].entry.position[axis] : storage.coordinates[axis][place];
+    }
+}
+
+/// <summary>
+/// The cell of the world the entry at a place in the cell storage is in.
+/// </summary>
+/// <param name="storage">The generation of the cells.</param>
+/// <param name="place">The place in the cell storage.</param>
+/// <returns>The coordinates of the cell.</returns>
+template<uint32_t Dim, typename Scalar>
+inline CellKey<Dim> BasicSpatialHash<Dim, Scalar>::StoredCell(const CellStorageType& storage, uint32_t place) const
+{
+    Scalar coordinates[Dim];
+    StoredPosition(storage, place, coordinates);
+
+    Key cell;
+    for (uint32_t axis = 0; axis < Dim; axis++)
+    {
+        cell[axis] = static_cast<int32_t>(floor((coordinates[axis] - origin[axis]) * invCellSize));
+    }
+
+    return cell;
+}
+
+/// <summary>
+/// Keeps track of which cell of the world the entries of a bucket are from, in HashMode::Hashed.
+/// The first entry of a bucket sets its tag, if a later one is from another cell the bucket is mixed.
+/// </summary>
+/// <param name="cellNr">The bucket an entry is added to.</param>
+/// <param name="count">Number of entries in the bucket before the entry.</param>
+/// <param name="pos">Position of the entry.</param>
+template<uint32_t Dim, typename Scalar>
+inline void BasicSpatialHash<Dim, Scalar>::TagCell(uint32_t cellNr, uint32_t count, PositionType pos)
+{
+    const Key tag = QuantizedCell(pos, cellNr);
+
+    if (count == 0)
+    {
+        cells->tags[cellNr] = tag;
+        cells->mixed[cellNr] = 0;
+    }
+    else if (cells->tags[cellNr] != tag)
+    {
+        cells->mixed[cellNr] = 1;
+    }
+}
+
+/// <summary>
+/// Counting sort of allEntered into the cells by hash value. The number of entries in each cell
+/// is counted, every cell is given room for its entries plus some spare and the start of each cell
+/// is the prefix sum of that. Then every entry is written to the next free place of its cell.
+/// Entries keep their relative order within a cell.
+/// </summary>
+template<uint32_t Dim, typename Scalar>
+void BasicSpatialHash<Dim, Scalar>::RebuildCells()
+{
+    SPATIALHASH_COUNT(PhaseTimer timer(*statCounters, Phase::Rebuild); statCounters->rebuilds++;)
+
+    vector<uint32_t>& cellStart = cells->cellStart;
+    vector<uint32_t>& cellCount = cells->cellCount;
+
+    std::fill(cellCount.begin(), cellCount.end(), 0);
+    for (uint32_t i = 0; i < numberOfAllEntries; i++)
+    {
+        if ((*allEntered)[i].hashValue != removedHashValue)
+        {
+            cellCount[(*allEntered)[i].hashValue]++;
+        }
+    }
+
+    // A quarter extra, and at least one, so entries can move in without a rebuild.
+    cellStart[0] = 0;
+    for (size_t c = 0; c != cellCount.size(); c++)
+    {
+        cellStart[c + 1] = cellStart[c] + cellCount[c] + cellCount[c] / 4 + 1;
+    }
+
+    // Only one of the ways to store the positions is used, the other is kept empty.
+    cells->ids.resize(cellStart.back());
+    for (uint32_t axis = 0; axis < Dim; axis++)
+    {
+        cells->coordinates[axis].resize(cells->compact ? 0 : cellStart.back());
+        cells->quantized[axis].resize(cells->compact ? cellStart.back() : 0);
+    }
+    cells->layers.resize(cells->layered ? cellStart.back() : 0);
+
+    // The counts are counted again while the entries are written to the cells.
+    std::fill(cellCount.begin(), cellCount.end(), 0);
+    for (uint32_t i = 0; i < numberOfAllEntries; i++)
+    {
+        EnteredType& entered = (*allEntered)[i];
+
+        if (entered.hashValue == removedHashValue)
+        {
+            continue;
+        }
+
+        uint32_t place = cellStart[entered.hashValue] + cellCount[entered.hashValue];
+
+        if (hashMode == HashMode::Hashed || cells->compact)
+        {
+            TagCell(entered.hashValue, cellCount[entered.hashValue], entered.entry.position);
+        }
+
+        cells->ids[place] = i;
+        StorePosition(place, entered.hashValue, entered.entry.position);
+        if (cells->layered)
+        {
+            cells->layers[place] = entered.layers;
+        }
+        entered.nrInCell = cellCount[entered.hashValue]++;
+    }
+}
+
+/// <summary>
+/// Gets cells ready to be changed. Unless double buffered they are changed in place. Otherwise the published
+/// cells are copied into the generation published before them, if no search still reads that one, or else
+/// into a new one. The copy keeps the places of the entries, so nrInCell in allEntered stays right.
+/// </summary>
+template<uint32_t Dim, typename Scalar>
+void BasicSpatialHash<Dim, Scalar>::BeginCellsUpdate()
+{
+    if (!doubleBuffered)
+    {
+        return;
+    }
+
+    shared_ptr<CellStorageType> next;
+
+    // Nothing new can start reading the spare cells since they aren't published, so once this is the
+    // only reference to them they are free. The fence orders the reads of the last search before the writes here.
+    if (spareCells && spareCells.use_count() == 1)
+    {
+        atomic_thread_fence(memory_order_acquire);
+        next = move(spareCells);
+    }
+    else
+    {
+        next = make_shared<CellStorageType>();
+    }
+
+    *next = *cells;
+
+    spareCells = move(cells);
+    cells = move(next);
+}
+
+/// <summary>
+/// Publishes cells to the searches, the ones already running keep the cells they started with.
+/// </summary>
+template<uint32_t Dim, typename Scalar>
+void BasicSpatialHash<Dim, Scalar>::PublishCells()
+{
+    cells->numberOfIds = numberOfAllEntries;
+
+    if (doubleBuffered)
+    {
+        atomic_store(&publishedCells, shared_ptr<const CellStorageType>(cells));
+    }
+}
+
+/// <summary>
+/// The cells that were published last. The searches hold on to them until they are done, so that an update
+/// that is run meanwhile writes other cells.
+/// </summary>
+/// <returns>The cells to search.</returns>
+template<uint32_t Dim, typename Scalar>
+shared_ptr<const typename BasicSpatialHash<Dim, Scalar>::CellStorageType> BasicSpatialHash<Dim, Scalar>::ReadCells() const
+{
+    return atomic_load(&publishedCells);
+}
+
+/// <summary>
+/// Turns double buffering on or off, see the header. Must not be called while something searches or updates.
+/// </summary>
+/// <param name="enabled">If updates write a copy of the cells.</param>
+template<uint32_t Dim, typename Scalar>
+void BasicSpatialHash<Dim, Scalar>::SetDoubleBuffered(bool enabled)
+{
+    // Compact cells read positions that updates write, see SetCompact().
+    if (enabled)
+    {
+        SetCompact(false);
+    }
+
+    doubleBuffered = enabled;
+
+    // When turned off the published cells are changed in place from now on.
+    if (!enabled)
+    {
+        spareCells.reset();
+    }
+}
+
+/// <summary>
+/// Turns compact cells on or off, see the header. The entries are sorted into the cells again to store them the other way.
+/// </summary>
+/// <param name="enabled">If the cells are compact, ignored while double buffered.</param>
+template<uint32_t Dim, typename Scalar>
+void BasicSpatialHash<Dim, Scalar>::SetCompact(bool enabled)
+{
+    enabled = enabled && !doubleBuffered;
+
+    if (cells->compact == enabled)
+    {
+        return;
+    }
+
+    cells->compact = enabled;
+    RebuildCells();
+    PublishCells();
+}
+
+/// <summary>
+/// Gives entries layer masks, see the header. The first call makes room for the masks in the cells by sorting
+/// the entries into them again, after that the masks are written where the entries are.
+/// </summary>
+/// <param name="nrOfEntries">Number of entries to give masks.</param>
+/// <param name="ids">Ids of the entries, ids that aren't in use are ignored.</param>
+/// <param name="layers">The layer mask of every entry.</param>
+template<uint32_t Dim, typename Scalar>
+void BasicSpatialHash<Dim, Scalar>::SetLayers(uint32_t nrOfEntries, const uint32_t* ids, const uint32_t* layers)
+{
+    BeginCellsUpdate();
+
+    for (uint32_t i = 0; i < nrOfEntries; i++)
+    {
+        const uint32_t id = ids[i];
+
+        if (id >= numberOfAllEntries || (*allEntered)[id].hashValue == removedHashValue)
+        {
+            continue;
+        }
+
+        EnteredType& entered = (*allEntered)[id];
+        entered.layers = layers[i];
+
+        if (cells->layered)
+        {
+            cells->layers[cells->cellStart[entered.hashValue] + entered.nrInCell] = layers[i];
+        }
+    }
+
+    if (!cells->layered)
+    {
+        cells->layered = true;
+        RebuildCells();
+    }
+
+    PublishCells();
+}
+
+/// <summary>
+/// Removes an entry from the hash table and makes its id free to be used by an inserted entry.
+/// Ids that aren't in use are ignored.
+/// </summary>
+/// <param name="entryIndex">Id of the entry to remove.</param>
+template<uint32_t Dim, typename Scalar>
+void BasicSpatialHash<Dim, Scalar>::RemoveEntryFromTable(uint32_t entryIndex)
+{
+    if (entryIndex >= numberOfAllEntries || (*allEntered)[entryIndex].hashValue == removedHashValue)
+    {
+        return;
+    }
+
+    RemoveFromCell(entryIndex, (*allEntered)[entryIndex].hashValue);
+
+    (*allEntered)[entryIndex].hashValue = removedHashValue;
+    freeIds->push_back(entryIndex);
+}
+
+/// <summary>
+/// Removes a number of entries from the hash table, see RemoveEntryFromTable().
+/// </summary>
+/// <param name="nrOfEntriesToRemove">Number of entries to remove.</param>
+/// <param name="entryIndices">Ids of the entries to remove.</param>
+template<uint32_t Dim, typename Scalar>
+void BasicSpatialHash<Dim, Scalar>::RemoveEntryFromTableBulk(uint32_t nrOfEntriesToRemove, uint32_t* entryIndices)
+{
+    BeginCellsUpdate();
+
+    for (uint32_t i = 0; i < nrOfEntriesToRemove; i++)
+    {
+        RemoveEntryFromTable(entryIndices[i]);
+    }
+
+    PublishCells();
+}
+
+/// <summary>
+/// Inserts a number of new entries into the hash table. Ids of removed entries are used again,
+/// when there are none left the number of entries grows. Entries are added straight into their cells,
+/// only if a cell runs out of room are all the entries sorted into their cells again.
+/// If an id is inside of allEntries the entry is written there as well, so that the next
+/// UpdateTable() starts from the inserted position.
+/// </summary>
+/// <param name="nrOfEntriesToInsert">Number of entries to insert.</param>
+/// <param name="positions">Positions of the new entries.</param>
+/// <param name="ids">The ids given to the new entries are written here, nrOfEntriesToInsert of them.</param>
+template<uint32_t Dim, typename Scalar>
+void BasicSpatialHash<Dim, Scalar>::InsertEntriesBulk(uint32_t nrOfEntriesToInsert, PositionType* positions, uint32_t* ids)
+{
+    BeginCellsUpdate();
+
+    bool rebuild = false;
+
+    for (uint32_t i = 0; i < nrOfEntriesToInsert; i++)
+    {
+        if (freeIds->empty())
+        {
+            SetNumberOfEntries(numberOfAllEntries + (nrOfEntriesToInsert - i));
+        }
+
+        uint32_t id = freeIds->back();
+        freeIds->pop_back();
+
+        EnteredType& entered = (*allEntered)[id];
+        entered.entry = EntryType(id, positions[i]);
+        entered.hashValue = CalculateCellNr(positions[i]);
+        entered.layers = allLayers;
+
+        if (id < numberOfAttachedEntries)
+        {
+            allEntries[id] = entered.entry;
+        }
+
+        // Once a cell is full everything is sorted again in the end anyway.
+        if (!rebuild && !AddToCell(id, entered.hashValue))
+        {
+            rebuild = true;
+        }
+
+        ids[i] = id;
+    }
+
+    if (rebuild)
+    {
+        RebuildCells();
+    }
+
+    PublishCells();
+}
+
+/// <summary>
+/// Points the hash table at a new array to read positions from in UpdateTable(), for example
+/// when the calling program has grown its array to fit inserted entries.
+/// </summary>
+/// <param name="inAllEntries">The array, the entry with id i is at place i.</param>
+/// <param name="numberOfEntries">The number of Entry:s in inAllEntries.</param>
+template<uint32_t Dim, typename Scalar>
+void BasicSpatialHash<Dim, Scalar>::AttachEntries(EntryType* inAllEntries, uint32_t numberOfEntries)
+{
+    allEntries = inAllEntries;
+    numberOfAttachedEntries = numberOfEntries;
+}
+
+/// <summary>
+/// Grows the number of ids to numberOfEntries. The new ids are free, the lowest is used first.
+/// </summary>
+/// <param name="numberOfEntries">The new number of ids.</param>
+template<uint32_t Dim, typename Scalar>
+void BasicSpatialHash<Dim, Scalar>::SetNumberOfEntries(uint32_t numberOfEntries)
+{
+    if (numberOfEntries <= numberOfAllEntries)
+    {
+        return;
+    }
+
+    allEntered->resize(numberOfEntries, EnteredType(EntryType(), 0, removedHashValue));
+
+    for (uint32_t id = numberOfEntries; id-- > numberOfAllEntries;)
+    {
+        freeIds->push_back(id);
+    }
+
+    numberOfAllEntries = numberOfEntries;
+}
+
+/// <summary>
+/// The hashing function with hysteresis. An entry stays in the cell it's in as long as it's no further
+/// than the hysteresis outside of the cell, along every axis.
+/// </summary>
+/// <param name="pos">The position of the entry.</param>
+/// <param name="currentCellNr">The cell the entry is in.</param>
+/// <returns>The cell the entry should be in.</returns>
+template<uint32_t Dim, typename Scalar>
+uint32_t BasicSpatialHash<Dim, Scalar>::CalculateCellNr(PositionType pos, uint32_t currentCellNr) const
+{
+    if (hysteresis > 0.0f)
+    {
+        const Key current = TableCoordinates(currentCellNr);
+        bool keep = true;
+
+        for (uint32_t axis = 0; axis < Dim && keep; axis++)
+        {
+            const int32_t low = TableCoordinate(static_cast<int32_t>(floor((pos[axis] - hysteresis - origin[axis]) * invCellSize)));
+            const int32_t high = TableCoordinate(static_cast<int32_t>(floor((pos[axis] + hysteresis - origin[axis]) * invCellSize)));
+
+            keep = low == current[axis] || high == current[axis];
+        }
+
+        if (keep)
+        {
+            return currentCellNr;
+        }
+    }
+
+    return CalculateCellNr(pos);
+}
+
+/// <summary>
+/// The hashing function. Calculates where in the spatial hash a position ends up.
+/// </summary>
+/// <param name="pos">The position to find a cell for.</param>
+/// <returns>The cell number associated with the input position.</returns>
+template<uint32_t Dim, typename Scalar>
+uint32_t BasicSpatialHash<Dim, Scalar>::CalculateCellNr(PositionType pos) const
+{
+    // Calculate where in the theoretical hash table, as large as the world, the entry would end up.
+    return HashCell(CellCoordinates(pos));
+}
+
+/// <summary>
+/// The cell of the world a position is in, counted from the origin. Not wrapped or clamped.
+/// </summary>
+/// <param name="pos">The position.</param>
+/// <returns>The coordinates of the cell.</returns>
+template<uint32_t Dim, typename Scalar>
+inline CellKey<Dim> BasicSpatialHash<Dim, Scalar>::CellCoordinates(const PositionType& pos) const
+{
+    Key cell;
+    for (uint32_t axis = 0; axis < Dim; axis++)
+    {
+        cell[axis] = static_cast<int32_t>(floor((pos[axis] - origin[axis]) * invCellSize));
+    }
+
+    return cell;
+}
+
+/// <summary>
+/// The cell of the world a coordinate is in along an axis, counted from the origin. Kept inside of a billion cells
+/// from the origin, so that shapes reaching very far, or not at all, can't overflow.
+/// </summary>
+/// <param name="axis">The axis.</param>
+/// <param name="coordinate">The coordinate along the axis.</param>
+/// <returns>The coordinate of the cell along the axis.</returns>
+template<uint32_t Dim, typename Scalar>
+inline int32_t BasicSpatialHash<Dim, Scalar>::CellCoordinate(uint32_t axis, double coordinate) const
+{
+    const double cell = floor((coordinate - origin[axis]) * invCellSize);
+
+    return static_cast<int32_t>(max(-1e9, min(1e9, cell)));
+}
+
+/// <summary>
+/// Where in the table a cell of the world ends up, depending on the hash mode.
+/// Wrapped: the coordinates are wrapped around the table, modulo the side length.
+/// Bounded: the coordinates are clamped to the table.
+/// Hashed: the coordinates are mixed into a bucket number.
+/// </summary>
+/// <param name="cell">The coordinates of the cell.</param>
+/// <returns>The cell number in the table.</returns>
+template<uint32_t Dim, typename Scalar>
+inline uint32_t BasicSpatialHash<Dim, Scalar>::HashCell(const Key& cell) const
+{
+    if (hashMode == HashMode::Hashed)
+    {
+        return MixCell<Dim>(cell) & static_cast<uint32_t>(table->size() - 1);
+    }
+
+    Key tableCell;
+    for (uint32_t axis = 0; axis < Dim; axis++)
+    {
+        tableCell[axis] = TableCoordinate(cell[axis]);
+    }
+
+    return TableCellNr(tableCell);
+}
+
+/// <summary>
+/// Where along an axis of the table a coordinate of a cell of the world ends up, wrapped around
+/// the table or, in a bounded one, clamped to it.
+/// </summary>
+/// <param name="coordinate">The coordinate of the cell of the world.</param>
+/// <returns>The coordinate in the table.</returns>
+template<uint32_t Dim, typename Scalar>
+inline int32_t BasicSpatialHash<Dim, Scalar>::TableCoordinate(int32_t coordinate) const
+{
+    if (hashMode == HashMode::Bounded)
+    {
+        return min(max(coordinate, 0), static_cast<int32_t>(sideLength) - 1);
+    }
+
+    return static_cast<int32_t>(static_cast<uint32_t>(coordinate) & mask);
+}
+
+/// <summary>
+/// The number of a cell of the table, x + y * sideLength + z * sideLength^2.
+/// </summary>
+/// <param name="tableCell">The coordinates of the cell in the table.</param>
+/// <returns>The cell number.</returns>
+template<uint32_t Dim, typename Scalar>
+inline uint32_t BasicSpatialHash<Dim, Scalar>::TableCellNr(const Key& tableCell) const
+{
+    uint32_t cellNr = 0;
+    for (uint32_t axis = Dim; axis-- > 0;)
+    {
+        cellNr = cellNr * sideLength + static_cast<uint32_t>(tableCell[axis]);
+    }
+
+    return cellNr;
+}
+
+/// <summary>
+/// The coordinates in the table of a cell, the opposite of TableCellNr().
+/// </summary>
+/// <param name="cellNr">The cell number.</param>
+/// <returns>The coordinates of the cell in the table.</returns>
+template<uint32_t Dim, typename Scalar>
+inline CellKey<Dim> BasicSpatialHash<Dim, Scalar>::TableCoordinates(uint32_t cellNr) const
+{
+    Key tableCell;
+    for (uint32_t axis = 0; axis < Dim; axis++)
+    {
+        tableCell[axis] = static_cast<int32_t>(cellNr & mask);
+        cellNr /= sideLength;
+    }
+
+    return tableCell;
+}
+
+/// <summary>
+/// Where in its cell, from 0 to 1, a coordinate is, for measuring the distance to other cells.
+/// In a bounded table positions outside of it are moved to its edge first.
+/// </summary>
+/// <param name="t">The coordinate measured in cells from the origin.</param>
+/// <returns>The fraction.</returns>
+template<uint32_t Dim, typename Scalar>
+inline float BasicSpatialHash<Dim, Scalar>::CellFraction(Scalar t) const
+{
+    Scalar cell = floor(t);
+
+    if (hashMode == HashMode::Bounded)
+    {
+        cell = min(max(cell, Scalar(0)), static_cast<Scalar>(sideLength - 1));
+    }
+
+    return static_cast<float>(min(max(t - cell, Scalar(0)), Scalar(1)));
+}
+
+/// <summary>
+/// Where in its cell a position is along every axis, see CellFraction().
+/// </summary>
+/// <param name="pos">The position.</param>
+/// <returns>The fractions.</returns>
+template<uint32_t Dim, typename Scalar>
+inline array<float, Dim> BasicSpatialHash<Dim, Scalar>::CellFractions(const PositionType& pos) const
+{
+    array<float, Dim> fractions;
+    for (uint32_t axis = 0; axis < Dim; axis++)
+    {
+        fractions[axis] = CellFraction((pos[axis] - origin[axis]) * invCellSize);
+    }
+
+    return fractions;
+}
+
+/// <summary>
+/// True if an entry that moved from one position to another, and has the same hash value at both,
+/// can keep its place in the cell. In HashMode::Hashed two cells of the world can share a bucket,
+/// so then it has to be the same cell as well for the tag of the bucket to stay right. The same goes
+/// for compact cells, which measure the entries from the cell of their tag, see QuantizedCell().
+/// </summary>
+/// <param name="from">Where the entry was.</param>
+/// <param name="to">Where the entry is.</param>
+/// <param name="cellNr">The cell the entry is in.</param>
+template<uint32_t Dim, typename Scalar>
+inline bool BasicSpatialHash<Dim, Scalar>::StaysInCell(PositionType from, PositionType to, uint32_t cellNr) const
+{
+    if (hashMode != HashMode::Hashed && !cells->compact)
+    {
+        return true;
+    }
+
+    return QuantizedCell(from, cellNr) == QuantizedCell(to, cellNr);
+}
+
+/// <summary>
+/// Gets all entities in the spatial hash that are within a certain distance of a position.
+/// </summary>
+/// <param name="storage">The generation of the cells to search.</param>
+/// <param name="pos">Where to search for entities.</param>
+/// <param name="d">The radius of the search area.</param>
+/// <param name="maxEntities">The max number of entities to return.</param>
+/// <param name="layerMask">The layers to look in, allLayers for every entry.</param>
+/// <param name="found">The entities found are appended to this, sorted by distance.</param>
+template<uint32_t Dim, typename Scalar>
+void BasicSpatialHash<Dim, Scalar>::GetCloseEntries(const CellStorageType& storage, PositionType pos, float d, int32_t maxEntities, uint32_t layerMask, vector<IdWithDistance>& found) const
+{
+    if (hashMode == HashMode::Hashed)
+    {
+        GetCloseEntriesHashed(storage, pos, d, maxEntities, layerMask, found);
+        return;
+    }
+
+    // This is the cell that will be the origo of the search.
+    uint32_t cellNr = CalculateCellNr(pos);
+
+    if (maxEntities <= 0)
+    {
+        return;
+    }
+
+    // Only the maxEntities closest entries are kept while searching.
+    ClosestSelection selection(found, maxEntities, d);
+    selection.layerMask = layerMask;
+
+    // Where in its cell the position is, measured in cells, for the distance to the other cells.
+    const array<float, Dim> fractions = CellFractions(pos);
+    const float squaredCellSize = static_cast<float>(1 / (invCellSize * invCellSize));
+
+    Scalar query[Dim];
+    for (uint32_t axis = 0; axis < Dim; axis++)
+    {
+        query[axis] = pos[axis];
+    }
+
+    SPATIALHASH_COUNT(const Key cell = CellCoordinates(pos);)
+
+    /* Loops through the different steps. The steps are sorted by how close their cells can be,
+    so once a step can't be closer than d, or than the furthest of maxEntities already found,
+    no later step can be either and the loop can end. */
+    const OffsetStep* steps = stepLists->data();
+    const uint32_t nrOfSteps = static_cast<uint32_t>(offsetsToCalculate.size());
+
+    // Cells near the edges work out their offsets from the unlocalized ones.
+    const bool nearEdge = (*table)[cellNr].nearEdge;
+    const Key tableCell = nearEdge ? TableCoordinates(cellNr) : Key{};
+
+    for (uint32_t i = 0; i < nrOfSteps; i++)
+    {
+        if (StepMinSquaredDistance(i) * squaredCellSize >= selection.Limit())
+        {
+            break;
+        }
+
+        const int32_t* offsets = offsetArena->data() + steps[i].start;
+        const Key* cellOffsets = offsetsToCalculate[i].data();
+
+        SPATIALHASH_COUNT(selection.counters.stepsWalked++;)
+
+        // Loops through all the offsets that belong to the current step.
+        for (uint32_t j = 0; j < steps[i].count; j++)
+        {
+            // The step's distance is from anywhere in the cell, from the position itself the cell can be further away.
+            if (SquaredCellGap(cellOffsets[j], fractions) * squaredCellSize >= selection.Limit())
+            {
+                SPATIALHASH_COUNT(selection.counters.cellsSkipped++;)
+                continue;
+            }
+
+            uint32_t offsetCell = cellNr + offsets[j];
+
+            if (nearEdge && !OffsetCellNearEdge(tableCell, cellOffsets[j], offsetCell))
+            {
+                continue;
+            }
+
+            GetCloseEntriesInCell(storage, offsetCell, query, selection);
+
+            SPATIALHASH_COUNT(
+                Key other = cell;
+                for (uint32_t axis = 0; axis < Dim; axis++)
+                {
+                    other[axis] += cellOffsets[j][axis];
+                }
+                selection.counters.aliasingRejections += CountAliased(storage, offsetCell, other);)
+        }
+    }
+
+    // Searches further than the offsets reach go on past them.
+    GetCloseEntriesBeyondOffsets(storage, pos, query, selection);
+
+    selection.Finish();
+
+    SPATIALHASH_COUNT(statCounters->Add(selection.counters);)
+}
+
+/// <summary>
+/// GetCloseEntries() for HashMode::Hashed. The offsets are added to the full coordinates of the cell of the
+/// position and every cell is hashed to find its bucket. Buckets that only hold entries from another cell of
+/// the world are skipped without reading them, from mixed buckets only the entries of the right cell are kept.
+/// </summary>
+/// <param name="storage">The generation of the cells to search.</param>
+/// <param name="pos">Where to search for entities.</param>
+/// <param name="d">The radius of the search area.</param>
+/// <param name="maxEntities">The max number of entities to return.</param>
+/// <param name="layerMask">The layers to look in, allLayers for every entry.</param>
+/// <param name="found">The entities found are appended to this, sorted by distance.</param>
+template<uint32_t Dim, typename Scalar>
+void BasicSpatialHash<Dim, Scalar>::GetCloseEntriesHashed(const CellStorageType& storage, PositionType pos, float d, int32_t maxEntities, uint32_t layerMask, vector<IdWithDistance>& found) const
+{
+    if (maxEntities <= 0)
+    {
+        return;
+    }
+
+    ClosestSelection selection(found, maxEntities, d);
+    selection.layerMask = layerMask;
+
+    const Key cell = CellCoordinates(pos);
+    const array<float, Dim> fractions = CellFractions(pos);
+    const float squaredCellSize = static_cast<float>(1 / (invCellSize * invCellSize));
+    const uint32_t nrOfSteps = static_cast<uint32_t>(offsetsToCalculate.size());
+
+    Scalar query[Dim];
+    for (uint32_t axis = 0; axis < Dim; axis++)
+    {
+        query[axis] = pos[axis];
+    }
+
+    for (uint32_t i = 0; i < nrOfSteps; i++)
+    {
+        if (StepMinSquaredDistance(i) * squaredCellSize >= selection.Limit())
+        {
+            break;
+        }
+
+        SPATIALHASH_COUNT(selection.counters.stepsWalked++;)
+
+        for (const Key& offset : offsetsToCalculate[i])
+        {
+            if (SquaredCellGap(offset, fractions) * squaredCellSize >= selection.Limit())
+            {
+                SPATIALHASH_COUNT(selection.counters.cellsSkipped++;)
+                continue;
+            }
+
+            Key other = cell;
+            for (uint32_t axis = 0; axis < Dim; axis++)
+            {
+                other[axis] += offset[axis];
+            }
+
+            const uint32_t bucket = HashCell(other);
+
+            if (storage.cellCount[bucket] == 0)
+            {
+                continue;
+            }
+
+            if (!storage.mixed[bucket])
+            {
+                if (storage.tags[bucket] == other)
+                {
+                    GetCloseEntriesInCell(storage, bucket, query, selection);
+                }
+                else
+                {
+                    SPATIALHASH_COUNT(selection.counters.cellsSkipped++;)
+                }
+
+                continue;
+            }
+
+            const uint32_t start = storage.cellStart[bucket];
+            const uint32_t* ids = storage.ids.data() + start;
+
+            SPATIALHASH_COUNT(
+                selection.counters.cellsVisited++;
+                selection.counters.candidatesTested += storage.cellCount[bucket];
+                selection.counters.aliasingRejections += CountAliased(storage, bucket, other);)
+
+            FindStoredWithinDistance(storage, bucket, start, storage.cellCount[bucket], query, static_cast<Scalar>(selection.Limit()), selection.layerMask,
+                [&](uint32_t m, float squaredDistance)
+            {
+                if (StoredCell(storage, start + m) == other)
+                {
+                    SPATIALHASH_COUNT(selection.counters.hits++;)
+                    selection.Offer(ids[m], squaredDistance);
+                }
+            });
+        }
+    }
+
+    // Searches further than the offsets reach go on past them.
+    GetCloseEntriesBeyondOffsets(storage, pos, query, selection);
+
+    selection.Finish();
+
+    SPATIALHASH_COUNT(statCounters->Add(selection.counters);)
+}
+
+/// <summary>
+/// The part of a search past the offsets, ring by ring of cells. Ring r is the cells r cells away from the cell of
+/// the position along the axis they are furthest away along, the offsets reach ringRadius. A ring is searched if
+/// the closest side of it is closer than selection.Limit(), which is the k:th closest distance once k entries
+/// are found, so a search stops as soon as no entry further out can be kept. Once a ring would go around the
+/// table, everything that isn't closer to the cell of the position than the ring is searched in one go instead.
+/// </summary>
+/// <param name="storage">The generation of the cells to search.</param>
+/// <param name="pos">Where to search for entities.</param>
+/// <param name="query">The position, its coordinate along every axis.</param>
+/// <param name="selection">Close entries are offered to this.</param>
+template<uint32_t Dim, typename Scalar>
+void BasicSpatialHash<Dim, Scalar>::GetCloseEntriesBeyondOffsets(const CellStorageType& storage, const PositionType& pos, const Scalar* query, ClosestSelection& selection) const
+{
+    const Key cell = CellCoordinates(pos);
+    const array<float, Dim> fractions = CellFractions(pos);
+    const float squaredCellSize = static_cast<float>(1 / (invCellSize * invCellSize));
+    const int32_t side = static_cast<int32_t>(sideLength);
+
+    Key center;
+    int32_t furthestRing = 0;
+    for (uint32_t axis = 0; axis < Dim; axis++)
+    {
+        center[axis] = TableCoordinate(cell[axis]);
+        furthestRing = max(furthestRing, max(center[axis], side - 1 - center[axis]));
+    }
+
+    int32_t r = ringRadius + 1;
+    for (; ; r++)
+    {
+        // The closest the ring comes is straight out along one of the axes.
+        float ringGap = numeric_limits<float>::max();
+        for (uint32_t axis = 0; axis < Dim; axis++)
+        {
+            ringGap = min(ringGap, min(CellGap(r, fractions[axis]), CellGap(-r, fractions[axis])));
+        }
+
+        if (ringGap * ringGap * squaredCellSize >= selection.Limit())
+        {
+            return;
+        }
+
+        // A bounded table ends before the rings do.
+        if (hashMode == HashMode::Bounded && r > furthestRing)
+        {
+            return;
+        }
+
+        if (hashMode != HashMode::Bounded && 2 * r + 1 > side)
+        {
+            break;
+        }
+
+        SPATIALHASH_COUNT(selection.counters.stepsWalked++;)
+
+        ForEachOnRing<Dim>(r, [&](const Key& offset)
+        {
+            if (SquaredCellGap(offset, fractions) * squaredCellSize >= selection.Limit())
+            {
+                SPATIALHASH_COUNT(selection.counters.cellsSkipped++;)
+                return;
+            }
+
+            if (hashMode != HashMode::Hashed)
+            {
+                Key tableCell;
+                for (uint32_t axis = 0; axis < Dim; axis++)
+                {
+                    tableCell[axis] = center[axis] + offset[axis];
+
+                    if (hashMode == HashMode::Bounded && (tableCell[axis] < 0 || tableCell[axis] >= side))
+                    {
+                        return;
+                    }
+
+                    tableCell[axis] &= static_cast<int32_t>(mask);
+                }
+
+                GetCloseEntriesInCell(storage, TableCellNr(tableCell), query, selection);
+                return;
+            }
+
+            Key other = cell;
+            for (uint32_t axis = 0; axis < Dim; axis++)
+            {
+                other[axis] += offset[axis];
+            }
+
+            const uint32_t bucket = HashCell(other);
+
+            if (storage.cellCount[bucket] == 0)
+            {
+                return;
+            }
+
+            if (!storage.mixed[bucket])
+            {
+                if (storage.tags[bucket] == other)
+                {
+                    GetCloseEntriesInCell(storage, bucket, query, selection);
+                }
+
+                return;
+            }
+
+            const uint32_t start = storage.cellStart[bucket];
+            const uint32_t* ids = storage.ids.data() + start;
+
+            FindStoredWithinDistance(storage, bucket, start, storage.cellCount[bucket], query, static_cast<Scalar>(selection.Limit()), selection.layerMask,
+                [&](uint32_t m, float squaredDistance)
+            {
+                if (StoredCell(storage, start + m) == other)
+                {
+                    selection.Offer(ids[m], squaredDistance);
+                }
+            });
+        });
+    }
+
+    /* The rings up to r - 1 went once around the cell of the position without overlapping. The rest of the table
+    is searched without telling how close its cells are, which only happens when there are few entries. */
+    const int32_t searchedRings = r - 1;
+    const uint32_t nrOfCells = static_cast<uint32_t>(table->size());
+
+    for (uint32_t cellNr = 0; cellNr < nrOfCells; cellNr++)
+    {
+        if (storage.cellCount[cellNr] == 0)
+        {
+            continue;
+        }
+
+        if (hashMode == HashMode::Wrapped)
+        {
+            const Key tableCell = TableCoordinates(cellNr);
+
+            int32_t distance = 0;
+            for (uint32_t axis = 0; axis < Dim; axis++)
+            {
+                int32_t around = (tableCell[axis] - center[axis]) & static_cast<int32_t>(mask);
+                distance = max(distance, min(around, side - around));
+            }
+
+            if (distance > searchedRings)
+            {
+                GetCloseEntriesInCell(storage, cellNr, query, selection);
+            }
+
+            continue;
+        }
+
+        const uint32_t start = storage.cellStart[cellNr];
+        const uint32_t* ids = storage.ids.data() + start;
+
+        FindStoredWithinDistance(storage, cellNr, start, storage.cellCount[cellNr], query, static_cast<Scalar>(selection.Limit()), selection.layerMask,
+            [&](uint32_t m, float squaredDistance)
+        {
+            const Key stored = StoredCell(storage, start + m);
+
+            int32_t distance = 0;
+            for (uint32_t axis = 0; axis < Dim; axis++)
+            {
+                distance = max(distance, abs(stored[axis] - cell[axis]));
+            }
+
+            if (distance > searchedRings)
+            {
+                selection.Offer(ids[m], squaredDistance);
+            }
+        });
+    }
+}
+
+/// <summary>
+/// Distance, in cells, from a position in a cell to the cell offset cells away along one side.
+/// </summary>
+/// <param name="offset">How many cells away the other cell is.</param>
+/// <param name="fraction">Where in its cell the position is, from 0 to 1.</param>
+/// <returns>The distance measured in cells.</returns>
+template<uint32_t Dim, typename Scalar>
+inline float BasicSpatialHash<Dim, Scalar>::CellGap(int32_t offset, float fraction) const
+{
+    float gap = offset > 0 ? offset - fraction : (offset < 0 ? fraction - offset - 1 : 0.0f);
+
+    // Entries can be up to the hysteresis outside of their cell.
+    return max(0.0f, gap - hysteresisInCells);
+}
+
+/// <summary>
+/// The squared distance, in cells, from a position in a cell to the cell at an offset, from CellGap() along every axis.
+/// </summary>
+/// <param name="offset">How many cells away the other cell is along every axis.</param>
+/// <param name="fractions">Where in its cell the position is along every axis.</param>
+/// <returns>The squared distance measured in cells.</returns>
+template<uint32_t Dim, typename Scalar>
+inline float BasicSpatialHash<Dim, Scalar>::SquaredCellGap(const Key& offset, const array<float, Dim>& fractions) const
+{
+    float squaredGap = 0.0f;
+    for (uint32_t axis = 0; axis < Dim; axis++)
+    {
+        float gap = CellGap(offset[axis], fractions[axis]);
+        squaredGap += gap * gap;
+    }
+
+    return squaredGap;
+}
+
+/// <summary>
+/// The smallest squared distance, measured in cells, from anywhere in a cell to the entries in the cells of a step.
+/// With hysteresis the entries can be outside of their cells, up to hysteresisInCells along every axis.
+/// </summary>
+/// <param name="step">The step.</param>
+/// <returns>The squared distance.</returns>
+template<uint32_t Dim, typename Scalar>
+inline float BasicSpatialHash<Dim, Scalar>::StepMinSquaredDistance(uint32_t step) const
+{
+    if (hysteresisInCells == 0.0f)
+    {
+        return (*stepMinSquaredDistances)[step];
+    }
+
+    // The hysteresis along every axis at once reaches the square root of Dim times as far.
+    float distance = max(0.0f, sqrtf((*stepMinSquaredDistances)[step]) - sqrtf(static_cast<float>(Dim)) * hysteresisInCells);
+
+    return distance * distance;
+}
+
+/// <summary>
+/// Gets all the entries in a cell of the hash table that are close enough to a position, pos, to be kept by selection.
+/// The distance tests are done on squared distances, square roots are only taken for the entries that are kept.
+/// </summary>
+/// <param name="storage">The generation of the cells to search.</param>
+/// <param name="cellIndex">Cell to look for close entries in.</param>
+/// <param name="query">Position to look for close entries around, its coordinate along every axis.</param>
+/// <param name="selection">Close entries are offered to this.</param>
+template<uint32_t Dim, typename Scalar>
+inline void BasicSpatialHash<Dim, Scalar>::GetCloseEntriesInCell(const CellStorageType& storage, uint32_t cellIndex, const Scalar* query, ClosestSelection& selection) const
+{
+    const uint32_t start = storage.cellStart[cellIndex];
+    const uint32_t count = storage.cellCount[cellIndex];
+    const uint32_t* ids = storage.ids.data() + start;
+
+    SPATIALHASH_COUNT(selection.counters.cellsVisited++; selection.counters.candidatesTested += count;)
+
+    /* Imporant because entites sharing cells can still be very far from each other because
+     * of the hashing/modulo on insertion. */
+    FindStoredWithinDistance(storage, cellIndex, start, count, query, static_cast<Scalar>(selection.Limit()), selection.layerMask,
+        [&](uint32_t m, float squaredDistance)
+        {
+            SPATIALHASH_COUNT(selection.counters.hits++;)
+            selection.Offer(ids[m], squaredDistance);
+        });
+}
+
+/// <summary>
+/// Counts the entries of a cell that are from another cell of the world than the one a search looked for there,
+/// which in a wrapped table are the ones from cells a table length or more away. With hysteresis entries can
+/// be in the cell next to the one they are stored for, so those aren't counted.
+/// </summary>
+/// <param name="storage">The generation of the cells to search.</param>
+/// <param name="cellIndex">The cell of the table.</param>
+/// <param name="cell">The cell of the world the search looked for.</param>
+/// <returns>The number of entries from other cells.</returns>
+template<uint32_t Dim, typename Scalar>
+uint32_t BasicSpatialHash<Dim, Scalar>::CountAliased(const CellStorageType& storage, uint32_t cellIndex, const Key& cell) const
+{
+    const int32_t tolerance = hysteresis > 0.0f ? 1 : 0;
+    const uint32_t start = storage.cellStart[cellIndex];
+    uint32_t aliased = 0;
+
+    for (uint32_t i = start; i < start + storage.cellCount[cellIndex]; i++)
+    {
+        const Key entryCell = StoredCell(storage, i);
+
+        for (uint32_t axis = 0; axis < Dim; axis++)
+        {
+            if (abs(entryCell[axis] - cell[axis]) > tolerance)
+            {
+                aliased++;
+                break;
+            }
+        }
+    }
+
+    return aliased;
+}
+
+/// <summary>
+/// Orders entries by distance, the furthest first when used for a heap.
+/// </summary>
+inline bool CloserThan(const IdWithDistance& a, const IdWithDistance& b)
+{
+    return a.distance < b.distance;
+}
+
+/// <summary>
+/// Starts a selection of the closest entries at the end of found.
+/// </summary>
+/// <param name="inFound">The kept entries are appended to this.</param>
+/// <param name="maxEntities">How many entries to keep.</param>
+/// <param name="d">Only entries closer than this are kept.</param>
+ClosestSelection::ClosestSelection(vector<IdWithDistance>& inFound, int32_t inMaxEntities, float d) : found(inFound), start(inFound.size()), maxEntities(max(0, inMaxEntities)), limit(d * d)
+{
+    // Up to this many kept entries, insertion sort moves fewer entries than the heap.
+    constexpr size_t maxInsertionSorted = 16;
+
+    useHeap = maxEntities > maxInsertionSorted;
+}
+
+/// <summary>
+/// Keeps an entry if it's among the maxEntities closest so far, which may push out the furthest one.
+/// </summary>
+/// <param name="id">Id of the entry.</param>
+/// <param name="squaredDistance">Squared distance to the entry.</param>
+inline void ClosestSelection::Offer(uint32_t id, float squaredDistance)
+{
+    // The limit can have shrunk since the distance was tested.
+    if (squaredDistance >= limit)
+    {
+        return;
+    }
+
+    bool full = IsFull();
+
+    if (useHeap)
+    {
+        if (full)
+        {
+            pop_heap(found.begin() + start, found.end(), CloserThan);
+            found.back() = IdWithDistance(id, squaredDistance);
+        }
+        else
+        {
+            found.push_back(IdWithDistance(id, squaredDistance));
+        }
+
+        push_heap(found.begin() + start, found.end(), CloserThan);
+    }
+    else
+    {
+        // When full the furthest, last, entry is overwritten.
+        if (!full)
+        {
+            found.push_back(IdWithDistance());
+        }
+
+        size_t k = found.size() - 1;
+        while (k > start && found[k - 1].distance > squaredDistance)
+        {
+            found[k] = found[k - 1];
+            k--;
+        }
+
+        found[k] = IdWithDistance(id, squaredDistance);
+    }
+
+    // Once full, only entries closer than the furthest kept one are of interest.
+    if (IsFull())
+    {
+        limit = useHeap ? found[start].distance : found.back().distance;
+    }
+}
+
+/// <summary>
+/// Sorts the kept entries by distance and takes the square root of their squared distances.
+/// </summary>
+void ClosestSelection::Finish()
+{
+    if (useHeap)
+    {
+        sort_heap(found.begin() + start, found.end(), CloserThan);
+    }
+
+    for (size_t i = start; i != found.size(); i++)
+    {
+        found[i].distance = sqrtf(found[i].distance);
+    }
+}
+
+/// <summary>
+/// For more efficent interoping GetCloseEntries requests are bunched together.
+/// </summary>
+/// <param name="nrSearches">How many GetCloseEntries requests that are bunched together.</param>
+/// <param name="pos">An array of postions, nrSearches long.</param>
+/// <param name="d">Distance in which entries are considered close.</param>
+/// <param name="maxEntities">Max number of entries per GetCloseEntries to return.</param>
+/// <returns>The entries that are close to the positions and how many of them there are.</returns>
+template<uint32_t Dim, typename Scalar>
+CloseIdsAndNrOf BasicSpatialHash<Dim, Scalar>::GetCloseEntriesBulk(int32_t nrSearches, PositionType* pos, float d, int32_t maxEntities)
+{
+    return GetCloseEntriesBulk(nrSearches, pos, d, maxEntities, allLayers);
+}
+
+/// <summary>
+/// Like GetCloseEntriesBulk(), but only entries in the layers of a layer mask are found. The mask is tested
+/// in the cells, before the distances, see FindStoredWithinDistance().
+/// </summary>
+/// <param name="nrSearches">How many searches that are bunched together.</param>
+/// <param name="pos">An array of postions, nrSearches long.</param>
+/// <param name="d">Distance in which entries are considered close.</param>
+/// <param name="maxEntities">Max number of entries per GetCloseEntries to return.</param>
+/// <param name="layerMask">The layers to look in.</param>
+/// <returns>The entries that are close to the positions and how many of them there are.</returns>
+template<uint32_t Dim, typename Scalar>
+CloseIdsAndNrOf BasicSpatialHash<Dim, Scalar>::GetCloseEntriesBulk(int32_t nrSearches, PositionType* pos, float d, int32_t maxEntities, uint32_t layerMask)
+{
+    // The offsets need to reach at least as far as the search.
+    SetMaxSearchDistance(d);
+
+    return GetCloseEntriesStrided(nrSearches, pos, &d, &maxEntities, 0, layerMask);
+}
+
+/// <summary>
+/// Like GetCloseEntriesBulk(), but every search has its own distance and max number of entries.
+/// </summary>
+/// <param name="nrSearches">How many searches that are bunched together.</param>
+/// <param name="pos">An array of postions, nrSearches long.</param>
+/// <param name="d">The distance of every search, nrSearches long.</param>
+/// <param name="maxEntities">Max number of entries of every search, nrSearches long.</param>
+/// <returns>The entries that are close to the positions and how many of them there are.</returns>
+template<uint32_t Dim, typename Scalar>
+CloseIdsAndNrOf BasicSpatialHash<Dim, Scalar>::GetCloseEntriesBulk(int32_t nrSearches, PositionType* pos, const float* d, const int32_t* maxEntities)
+{
+    // The offsets need to reach as far as the longest search.
+    float maxD = 0.0f;
+    for (int32_t i = 0; i < nrSearches; i++)
+    {
+        maxD = max(maxD, d[i]);
+    }
+
+    SetMaxSearchDistance(maxD);
+
+    return GetCloseEntriesStrided(nrSearches, pos, d, maxEntities, 1, allLayers);
+}
+
+/// <summary>
+/// Gets the k closest entries to every position. The search distance is infinite, so the searches stop on
+/// the k:th closest entry instead, see GetCloseEntriesBeyondOffsets().
+/// </summary>
+/// <param name="nrSearches">How many searches that are bunched together.</param>
+/// <param name="pos">An array of postions, nrSearches long.</param>
+/// <param name="k">The number of entries to find for every position.</param>
+/// <returns>The closest entries to the positions and how many of them there are.</returns>
+template<uint32_t Dim, typename Scalar>
+CloseIdsAndNrOf BasicSpatialHash<Dim, Scalar>::GetNearestEntriesBulk(int32_t nrSearches, PositionType* pos, int32_t k)
+{
+    const float d = numeric_limits<float>::infinity();
+
+    return GetCloseEntriesStrided(nrSearches, pos, &d, &k, 0, allLayers);
+}
+
+/// <summary>
+/// Gets the entries inside of every box, see GetEntriesInBox().
+/// </summary>
+/// <param name="nrSearches">How many boxes that are bunched together.</param>
+/// <param name="lows">The lowest corner of every box, nrSearches long.</param>
+/// <param name="highs">The highest corner of every box, nrSearches long.</param>
+/// <param name="maxEntities">Max number of entries per box to return.</param>
+/// <returns>The entries inside of the boxes and how many of them there are.</returns>
+template<uint32_t Dim, typename Scalar>
+CloseIdsAndNrOf BasicSpatialHash<Dim, Scalar>::GetEntriesInBoxesBulk(int32_t nrSearches, const PositionType* lows, const PositionType* highs, int32_t maxEntities)
+{
+    SPATIALHASH_COUNT(PhaseTimer timer(*statCounters, Phase::Search);)
+
+    const shared_ptr<const CellStorageType> generation = ReadCells();
+    const CellStorageType& storage = *generation;
+
+    return RunSearches(nrSearches, &maxEntities, 0, [&](int32_t i, vector<IdWithDistance>& found)
+    {
+        GetEntriesInBox(storage, lows[i], highs[i], maxEntities, found);
+    });
+}
+
+/// <summary>
+/// Gets the entries close to every segment, see GetEntriesAlongSegment().
+/// </summary>
+/// <param name="nrSearches">How many segments that are bunched together.</param>
+/// <param name="from">Where every segment starts, nrSearches long.</param>
+/// <param name="to">Where every segment ends, nrSearches long.</param>
+/// <param name="d">How close to a segment entries have to be.</param>
+/// <param name="maxEntities">Max number of entries per segment to return.</param>
+/// <returns>The entries close to the segments and how many of them there are.</returns>
+template<uint32_t Dim, typename Scalar>
+CloseIdsAndNrOf BasicSpatialHash<Dim, Scalar>::GetEntriesAlongSegmentsBulk(int32_t nrSearches, const PositionType* from, const PositionType* to, float d, int32_t maxEntities)
+{
+    SPATIALHASH_COUNT(PhaseTimer timer(*statCounters, Phase::Search);)
+
+    const shared_ptr<const CellStorageType> generation = ReadCells();
+    const CellStorageType& storage = *generation;
+
+    return RunSearches(nrSearches, &maxEntities, 0, [&](int32_t i, vector<IdWithDistance>& found)
+    {
+        GetEntriesAlongSegment(storage, from[i], to[i], d, false, maxEntities, found);
+    });
+}
+
+/// <summary>
+/// Gets the entries every moving circle touches, see GetEntriesAlongSegment().
+/// </summary>
+/// <param name="nrSearches">How many circles that are bunched together.</param>
+/// <param name="from">Where every circle starts, nrSearches long.</param>
+/// <param name="to">Where every circle ends up, nrSearches long.</param>
+/// <param name="radius">The radius of the circles.</param>
+/// <param name="maxEntities">Max number of entries per circle to return.</param>
+/// <returns>The entries the circles touch and how many of them there are.</returns>
+template<uint32_t Dim, typename Scalar>
+CloseIdsAndNrOf BasicSpatialHash<Dim, Scalar>::GetEntriesSweptBulk(int32_t nrSearches, const PositionType* from, const PositionType* to, float radius, int32_t maxEntities)
+{
+    SPATIALHASH_COUNT(PhaseTimer timer(*statCounters, Phase::Search);)
+
+    const shared_ptr<const CellStorageType> generation = ReadCells();
+    const CellStorageType& storage = *generation;
+
+    return RunSearches(nrSearches, &maxEntities, 0, [&](int32_t i, vector<IdWithDistance>& found)
+    {
+        GetEntriesAlongSegment(storage, from[i], to[i], radius, true, maxEntities, found);
+    });
+}
+
+/// <summary>
+/// Runs the searches of a bulk search, see RunSearches().
+/// </summary>
+/// <param name="nrSearches">How many searches that are bunched together.</param>
+/// <param name="pos">An array of postions, nrSearches long.</param>
+/// <param name="d">Distance of search i is d[i * stride].</param>
+/// <param name="maxEntities">Max number of entries of search i is maxEntities[i * stride].</param>
+/// <param name="stride">1 if every search has its own d and maxEntities, 0 if they all share the first.</param>
+/// <param name="layerMask">The layers every search looks in.</param>
+/// <returns>The entries that are close to the positions and how many of them there are.</returns>
+template<uint32_t Dim, typename Scalar>
+CloseIdsAndNrOf BasicSpatialHash<Dim, Scalar>::GetCloseEntriesStrided(int32_t nrSearches, PositionType* pos, const float* d, const int32_t* maxEntities, uint32_t stride, uint32_t layerMask)
+{
+    SPATIALHASH_COUNT(PhaseTimer timer(*statCounters, Phase::Search);)
+
+    // Kept until the searches are done, an update meanwhile writes other cells if double buffered.
+    const shared_ptr<const CellStorageType> generation = ReadCells();
+    const CellStorageType& storage = *generation;
+
+    return RunSearches(nrSearches, maxEntities, stride, [&](int32_t i, vector<IdWithDistance>& found)
+    {
+        GetCloseEntries(storage, pos[i], d[i * stride], maxEntities[i * stride], layerMask, found);
+    });
+}
+
+/// <summary>
+/// Runs the searches of a bulk search. Large bunches are split into one part per worker thread.
+/// Each part is searched into its own QueryBuffer and afterwards the parts are copied, in order,
+/// into closeEntries and nrOfEntries.
+/// </summary>
+/// <param name="nrSearches">How many searches that are bunched together.</param>
+/// <param name="maxEntities">Max number of entries of search i is maxEntities[i * stride], to make room for them.</param>
+/// <param name="stride">1 if every search has its own maxEntities, 0 if they all share the first.</param>
+/// <param name="search">search(i, found) appends the entries search i finds to found.</param>
+/// <returns>The entries that were found and how many of them there are.</returns>
+template<uint32_t Dim, typename Scalar>
+template<typename Search>
+CloseIdsAndNrOf BasicSpatialHash<Dim, Scalar>::RunSearches(int32_t nrSearches, const int32_t* maxEntities, uint32_t stride, Search&& search)
+{
+    // Below this many searches per thread it's not worth waking up the other threads.
+    constexpr int32_t minSearchesPerPart = 64;
+
+    // Runs the searches [from, to), appending where the results of every search end in found to ends.
+    auto SearchRange = [&search](int32_t from, int32_t to, vector<IdWithDistance>& found, vector<uint32_t>& ends)
+    {
+        for (int32_t i = from; i < to; i++)
+        {
+            search(i, found);
+            ends.push_back(static_cast<uint32_t>(found.size()));
+        }
+    };
+
+    // Since new entries to return is to be calculated we need to get rid of the old ones.
+    closeEntries->clear();
+    nrOfEntries->clear();
+
+    if (nrSearches <= 0)
+    {
+        nrOfEntries->push_back(0);
+        return CloseIdsAndNrOf{ nrOfEntries->data(), closeEntries->data() };
+    }
+
+    // How many entries the searches [from, to) can find at most, to reserve room for them.
+    auto MaxFound = [maxEntities, stride](int32_t from, int32_t to)
+    {
+        if (stride == 0)
+        {
+            return static_cast<size_t>(to - from) * max(0, maxEntities[0]);
+        }
+
+        size_t sum = 0;
+        for (int32_t i = from; i < to; i++)
+        {
+            sum += max(0, maxEntities[i]);
+        }
+
+        return sum;
+    };
+
+    int32_t nrOfParts = min(static_cast<int32_t>(workers->NrOfWorkers()), nrSearches / minSearchesPerPart);
+
+    if (nrOfParts <= 1)
+    {
+        closeEntries->reserve(MaxFound(0, nrSearches));
+        nrOfEntries->reserve(nrSearches);
+
+        SearchRange(0, nrSearches, *closeEntries, *nrOfEntries);
+
+        return CloseIdsAndNrOf{ nrOfEntries->data(), closeEntries->data() };
+    }
+
+    if (queryBuffers->size() < static_cast<size_t>(nrOfParts))
+    {
+        queryBuffers->resize(nrOfParts);
+    }
+
+    // Every part gets a contiguous range of the searches so the results can be merged in order.
+    auto partStart = [nrSearches, nrOfParts](int32_t part)
+    {
+        return static_cast<int32_t>(static_cast<int64_t>(nrSearches) * part / nrOfParts);
+    };
+
+    workers->Run(nrOfParts, [&](uint32_t part)
+    {
+        QueryBufferType& buffer = (*queryBuffers)[part];
+        buffer.closeEntries.clear();
+        buffer.nrOfEntries.clear();
+        buffer.closeEntries.reserve(MaxFound(partStart(part), partStart(part + 1)));
+        buffer.nrOfEntries.reserve(partStart(part + 1) - partStart(part));
+
+        SearchRange(partStart(part), partStart(part + 1), buffer.closeEntries, buffer.nrOfEntries);
+    });
+
+    // Prefix sum of the number of entries found by each part gives where the parts are copied to.
+    vector<uint32_t> partOffset(nrOfParts + 1, 0);
+    for (int32_t part = 0; part < nrOfParts; part++)
+    {
+        partOffset[part + 1] = partOffset[part] + static_cast<uint32_t>((*queryBuffers)[part].closeEntries.size());
+    }
+
+    closeEntries->resize(partOffset[nrOfParts]);
+    nrOfEntries->resize(nrSearches);
+
+    workers->Run(nrOfParts, [&](uint32_t part)
+    {
+        const QueryBufferType& buffer = (*queryBuffers)[part];
+
+        std::copy(buffer.closeEntries.begin(), buffer.closeEntries.end(), closeEntries->begin() + partOffset[part]);
+
+        for (size_t i = 0; i != buffer.nrOfEntries.size(); i++)
+        {
+            (*nrOfEntries)[partStart(part) + i] = buffer.nrOfEntries[i] + partOffset[part];
+        }
+    });
+
+    return CloseIdsAndNrOf{ nrOfEntries->data(), closeEntries->data() };
+}
+
+/// <summary>
+/// Gets the entries inside of a box, edges included, sorted by their distance from its center. Entries can be
+/// up to the hysteresis outside of the cell they are stored in, so the cells that far around the box are searched.
+/// </summary>
+/// <param name="storage">The generation of the cells to search.</param>
+/// <param name="low">The lowest corner of the box.</param>
+/// <param name="high">The highest corner of the box.</param>
+/// <param name="maxEntities">Max number of entries to return, the closest to the center.</param>
+/// <param name="found">The entries are appended to this.</param>
+template<uint32_t Dim, typename Scalar>
+void BasicSpatialHash<Dim, Scalar>::GetEntriesInBox(const CellStorageType& storage, const PositionType& low, const PositionType& high, int32_t maxEntities, vector<IdWithDistance>& found) const
+{
+    thread_local vector<uint32_t> cellNrs;
+
+    if (maxEntities <= 0)
+    {
+        return;
+    }
+
+    double center[Dim];
+    Key lowCell, highCell;
+    for (uint32_t axis = 0; axis < Dim; axis++)
+    {
+        // Nothing is inside of a box that is inside out.
+        if (!(low[axis] <= high[axis]))
+        {
+            return;
+        }
+
+        center[axis] = 0.5 * (static_cast<double>(low[axis]) + high[axis]);
+        lowCell[axis] = CellCoordinate(axis, static_cast<double>(low[axis]) - hysteresis);
+        highCell[axis] = CellCoordinate(axis, static_cast<double>(high[axis]) + hysteresis);
+    }
+
+    ShapeCells(lowCell, highCell, [&](const Key&, int32_t& first, int32_t& last)
+    {
+        first = lowCell[0];
+        last = highCell[0];
+        return true;
+    }, cellNrs);
+
+    GetEntriesInCells(storage, cellNrs, maxEntities, [&](const Scalar* coordinates, float& squaredDistance)
+    {
+        double fromCenter = 0.0;
+        for (uint32_t axis = 0; axis < Dim; axis++)
+        {
+            if (coordinates[axis] < low[axis] || coordinates[axis] > high[axis])
+            {
+                return false;
+            }
+
+            const double delta = coordinates[axis] - center[axis];
+            fromCenter += delta * delta;
+        }
+
+        squaredDistance = static_cast<float>(fromCenter);
+        return true;
+    }, found);
+}
+
+/// <summary>
+/// Gets the entries closer than d to a segment. Instead of stepping through the cells along the segment one at
+/// a time, every row of cells along the first axis that the segment, widened by d and the hysteresis, passes
+/// through gets the span of cells it passes in that row. Just as cheap, and it doesn't miss the cells a step
+/// would cut corners past.
+/// Along a segment the distance of an entry is how far from the start the point of the segment closest to it is.
+/// When swept it's how far a circle of radius d has moved along the segment when it first touches the entry.
+/// </summary>
+/// <param name="storage">The generation of the cells to search.</param>
+/// <param name="from">Where the segment starts.</param>
+/// <param name="to">Where the segment ends.</param>
+/// <param name="d">How close to the segment entries have to be.</param>
+/// <param name="swept">If the distance is where a circle moving along the segment first touches the entry.</param>
+/// <param name="maxEntities">Max number of entries to return, the first along the segment.</param>
+/// <param name="found">The entries are appended to this.</param>
+template<uint32_t Dim, typename Scalar>
+void BasicSpatialHash<Dim, Scalar>::GetEntriesAlongSegment(const CellStorageType& storage, const PositionType& from, const PositionType& to, float d, bool swept, int32_t maxEntities, vector<IdWithDistance>& found) const
+{
+    thread_local vector<uint32_t> cellNrs;
+
+    if (maxEntities <= 0 || !(d > 0.0f))
+    {
+        return;
+    }
+
+    const double cellSize = 1.0 / invCellSize;
+
+    // A little more than d and the hysteresis, so rounding doesn't leave out the cells right at the edge.
+    const double reach = static_cast<double>(d) + hysteresis + 1e-3 * cellSize;
+    const double dSquared = static_cast<double>(d) * d;
+
+    double start[Dim];
+    double direction[Dim];
+    double lengthSquared = 0.0;
+    Key lowCell, highCell;
+    for (uint32_t axis = 0; axis < Dim; axis++)
+    {
+        start[axis] = from[axis];
+        direction[axis] = static_cast<double>(to[axis]) - from[axis];
+        lengthSquared += direction[axis] * direction[axis];
+
+        lowCell[axis] = CellCoordinate(axis, min(start[axis], start[axis] + direction[axis]) - reach);
+        highCell[axis] = CellCoordinate(axis, max(start[axis], start[axis] + direction[axis]) + reach);
+    }
+
+    const double length = sqrt(lengthSquared);
+
+    // The part of the segment within reach of a row is clipped against the row, widened by reach, along every
+    // other axis. The cells from where that part starts to where it ends, widened by reach, are searched.
+    ShapeCells(lowCell, highCell, [&](const Key& row, int32_t& first, int32_t& last)
+    {
+        double enter = 0.0;
+        double leave = 1.0;
+        for (uint32_t axis = 1; axis < Dim; axis++)
+        {
+            const double rowLow = origin[axis] + row[axis] * cellSize - reach;
+            const double rowHigh = origin[axis] + (row[axis] + 1.0) * cellSize + reach;
+
+            if (direction[axis] == 0.0)
+            {
+                if (start[axis] < rowLow || start[axis] > rowHigh)
+                {
+                    return false;
+                }
+
+                continue;
+            }
+
+            const double a = (rowLow - start[axis]) / direction[axis];
+            const double b = (rowHigh - start[axis]) / direction[axis];
+            enter = max(enter, min(a, b));
+            leave = min(leave, max(a, b));
+
+            if (enter > leave)
+            {
+                return false;
+            }
+        }
+
+        const double entered = start[0] + enter * direction[0];
+        const double left = start[0] + leave * direction[0];
+        first = max(lowCell[0], CellCoordinate(0, min(entered, left) - reach));
+        last = min(highCell[0], CellCoordinate(0, max(entered, left) + reach));
+
+        return first <= last;
+    }, cellNrs);
+
+    GetEntriesInCells(storage, cellNrs, maxEntities, [&](const Scalar* coordinates, float& squaredDistance)
+    {
+        double relative[Dim];
+        double along = 0.0;
+        for (uint32_t axis = 0; axis < Dim; axis++)
+        {
+            relative[axis] = coordinates[axis] - start[axis];
+            along += relative[axis] * direction[axis];
+        }
+
+        // Where on the segment the point closest to the entry is, from 0 at the start to 1 at the end.
+        const double t = lengthSquared > 0.0 ? min(1.0, max(0.0, along / lengthSquared)) : 0.0;
+
+        double gapSquared = 0.0;
+        double fromStartSquared = 0.0;
+        for (uint32_t axis = 0; axis < Dim; axis++)
+        {
+            const double gap = relative[axis] - t * direction[axis];
+            gapSquared += gap * gap;
+            fromStartSquared += relative[axis] * relative[axis];
+        }
+
+        if (gapSquared >= dSquared)
+        {
+            return false;
+        }
+
+        double distance = t * length;
+        if (swept)
+        {
+            if (fromStartSquared < dSquared)
+            {
+                // Touched from the start.
+                distance = 0.0;
+            }
+            else
+            {
+                // The circle first touches the entry where the line through the segment is d from it, which is
+                // before the closest point by as much as the entry is within d of the line.
+                const double projected = along / length;
+                const double lineGapSquared = max(0.0, fromStartSquared - projected * projected);
+                distance = min(length, max(0.0, projected - sqrt(max(0.0, dSquared - lineGapSquared))));
+            }
+        }
+
+        squaredDistance = static_cast<float>(distance * distance);
+        return true;
+    }, found);
+}
+
+/// <summary>
+/// Gets the cells of the table a shape is in. The shape is given as a span of cells along the first axis for
+/// every row of cells, along the other axes, from lowCell to highCell. Cells of the world a table length apart
+/// in a wrapped table, clamped into the same edge cell of a bounded one or hashed into the same bucket, end up
+/// in the same cell of the table, which is only listed once, so no entry is found twice. When the shape covers
+/// more cells of the world than there are in the table, all the cells of the table are listed instead.
+/// </summary>
+/// <param name="lowCell">The lowest cell of the world of the shape, along every axis.</param>
+/// <param name="highCell">The highest cell of the world of the shape, along every axis.</param>
+/// <param name="span">span(row, first, last) gets the cells of a row along the first axis, false if there are none.</param>
+/// <param name="cellNrs">Gets the cells of the table, sorted.</param>
+template<uint32_t Dim, typename Scalar>
+template<typename Span>
+void BasicSpatialHash<Dim, Scalar>::ShapeCells(const Key& lowCell, const Key& highCell, Span&& span, vector<uint32_t>& cellNrs) const
+{
+    const uint32_t nrOfCells = static_cast<uint32_t>(table->size());
+
+    cellNrs.clear();
+
+    uint64_t nrOfRows = 1;
+    for (uint32_t axis = 1; axis < Dim; axis++)
+    {
+        nrOfRows *= static_cast<uint64_t>(static_cast<int64_t>(highCell[axis]) - lowCell[axis] + 1);
+    }
+
+    bool wholeTable = nrOfRows > nrOfCells;
+
+    Key cell = lowCell;
+    while (!wholeTable)
+    {
+        int32_t first;
+        int32_t last;
+        if (span(cell, first, last))
+        {
+            if (cellNrs.size() + static_cast<uint64_t>(static_cast<int64_t>(last) - first + 1) > nrOfCells)
+            {
+                wholeTable = true;
+                break;
+            }
+
+            for (cell[0] = first; cell[0] < last; cell[0]++)
+            {
+                cellNrs.push_back(HashCell(cell));
+            }
+
+            cellNrs.push_back(HashCell(cell));
+        }
+
+        // The next row, counting up like an odometer along the other axes.
+        uint32_t axis = 1;
+        while (axis < Dim && cell[axis] == highCell[axis])
+        {
+            cell[axis] = lowCell[axis];
+            axis++;
+        }
+
+        if (axis == Dim)
+        {
+            break;
+        }
+
+        cell[axis]++;
+    }
+
+    if (wholeTable)
+    {
+        cellNrs.resize(nrOfCells);
+        for (uint32_t cellNr = 0; cellNr < nrOfCells; cellNr++)
+        {
+            cellNrs[cellNr] = cellNr;
+        }
+
+        return;
+    }
+
+    sort(cellNrs.begin(), cellNrs.end());
+    cellNrs.erase(unique(cellNrs.begin(), cellNrs.end()), cellNrs.end());
+}
+
+/// <summary>
+/// Tests every entry in some cells of the table, keeping the closest of the ones that pass.
+/// </summary>
+/// <param name="storage">The generation of the cells to search.</param>
+/// <param name="cellNrs">The cells of the table, each only once.</param>
+/// <param name="maxEntities">Max number of entries to keep.</param>
+/// <param name="test">test(coordinates, squaredDistance) is true for the entries to keep and gets their squared distance.</param>
+/// <param name="found">The kept entries are appended to this, sorted by distance.</param>
+template<uint32_t Dim, typename Scalar>
+template<typename Test>
+void BasicSpatialHash<Dim, Scalar>::GetEntriesInCells(const CellStorageType& storage, const vector<uint32_t>& cellNrs, int32_t maxEntities, Test&& test, vector<IdWithDistance>& found) const
+{
+    ClosestSelection selection(found, maxEntities, numeric_limits<float>::infinity());
+
+    for (uint32_t cellNr : cellNrs)
+    {
+        const uint32_t start = storage.cellStart[cellNr];
+        const uint32_t count = storage.cellCount[cellNr];
+
+        SPATIALHASH_COUNT(selection.counters.cellsVisited++; selection.counters.candidatesTested += count;)
+
+        for (uint32_t place = start; place < start + count; place++)
+        {
+            Scalar coordinates[Dim];
+            StoredPosition(storage, place, coordinates);
+
+            float squaredDistance;
+            if (test(coordinates, squaredDistance))
+            {
+                SPATIALHASH_COUNT(selection.counters.hits++;)
+                selection.Offer(storage.ids[place], squaredDistance);
+            }
+        }
+    }
+
+    selection.Finish();
+
+    SPATIALHASH_COUNT(statCounters->Add(selection.counters);)
+}
+
+/// <summary>
+/// Runs searches into buffers owned by the caller. Only reads the Spatial Hash, each thread has its own
+/// list to select the closest entries in, which are then copied to the caller's buffer. If the results of
+/// a search don't fit in what is left of the buffer, the searching stops before that search.
+/// </summary>
+/// <param name="nrSearches">How many searches that are bunched together.</param>
+/// <param name="pos">An array of postions, nrSearches long.</param>
+/// <param name="d">Distance in which entries are considered close.</param>
+/// <param name="maxEntities">Max number of entries per search to return.</param>
+/// <param name="outNrOfEntries">Gets where the results of every search end in outCloseEntries.</param>
+/// <param name="outCloseEntries">Gets the results.</param>
+/// <param name="capacity">The number of IdWithDistance:s outCloseEntries has room for.</param>
+/// <returns>How many searches were done, how many entries were written and if the buffer was too small.</returns>
+template<uint32_t Dim, typename Scalar>
+SearchResult BasicSpatialHash<Dim, Scalar>::GetCloseEntriesInto(int32_t nrSearches, const PositionType* pos, float d, int32_t maxEntities, uint32_t* outNrOfEntries, IdWithDistance* outCloseEntries, uint32_t capacity) const
+{
+    thread_local vector<IdWithDistance> found;
+
+    SPATIALHASH_COUNT(PhaseTimer timer(*statCounters, Phase::Search);)
+
+    const shared_ptr<const CellStorageType> generation = ReadCells();
+
+    uint32_t written = 0;
+
+    for (int32_t i = 0; i < nrSearches; i++)
+    {
+        found.clear();
+        GetCloseEntries(*generation, pos[i], d, maxEntities, allLayers, found);
+
+        if (found.size() > capacity - written)
+        {
+            return SearchResult{ static_cast<uint32_t>(i), written, 1 };
+        }
+
+        std::copy(found.begin(), found.end(), outCloseEntries + written);
+        written += static_cast<uint32_t>(found.size());
+        outNrOfEntries[i] = written;
+    }
+
+    return SearchResult{ static_cast<uint32_t>(max(0, nrSearches)), written, 0 };
+}
+
+/// <summary>
+/// The same as GetCloseEntriesInto(), but large bunches are split into one part per worker thread like
+/// RunSearches(). Each part is searched into its own buffer of jobBuffers, and afterwards the parts are copied,
+/// in order, to the caller's buffers, up to the first search that doesn't fit. Only the job queue uses jobBuffers,
+/// so searches of the caller can run meanwhile.
+/// </summary>
+/// <param name="nrSearches">How many searches that are bunched together.</param>
+/// <param name="pos">An array of postions, nrSearches long.</param>
+/// <param name="d">Distance in which entries are considered close.</param>
+/// <param name="maxEntities">Max number of entries per search to return.</param>
+/// <param name="outNrOfEntries">Gets where the results of every search end in outCloseEntries.</param>
+/// <param name="outCloseEntries">Gets the results.</param>
+/// <param name="capacity">The number of IdWithDistance:s outCloseEntries has room for.</param>
+/// <returns>How many searches were done, how many entries were written and if the buffer was too small.</returns>
+template<uint32_t Dim, typename Scalar>
+SearchResult BasicSpatialHash<Dim, Scalar>::GetCloseEntriesIntoSplit(int32_t nrSearches, const PositionType* pos, float d, int32_t maxEntities, uint32_t* outNrOfEntries, IdWithDistance* outCloseEntries, uint32_t capacity) const
+{
+    // Below this many searches per thread it's not worth waking up the other threads.
+    constexpr int32_t minSearchesPerPart = 64;
+
+    const int32_t nrOfParts = min(static_cast<int32_t>(workers->NrOfWorkers()), nrSearches / minSearchesPerPart);
+
+    if (nrOfParts <= 1)
+    {
+        return GetCloseEntriesInto(nrSearches, pos, d, maxEntities, outNrOfEntries, outCloseEntries, capacity);
+    }
+
+    SPATIALHASH_COUNT(PhaseTimer timer(*statCounters, Phase::Search);)
+
+    const shared_ptr<const CellStorageType> generation = ReadCells();
+
+    if (jobBuffers->size() < static_cast<size_t>(nrOfParts))
+    {
+        jobBuffers->resize(nrOfParts);
+    }
+
+    auto partStart = [nrSearches, nrOfParts](int32_t part)
+    {
+        return static_cast<int32_t>(static_cast<int64_t>(nrSearches) * part / nrOfParts);
+    };
+
+    workers->Run(nrOfParts, [&](uint32_t part)
+    {
+        QueryBufferType& buffer = (*jobBuffers)[part];
+        buffer.closeEntries.clear();
+        buffer.nrOfEntries.clear();
+
+        for (int32_t i = partStart(part); i < partStart(part + 1); i++)
+        {
+            GetCloseEntries(*generation, pos[i], d, maxEntities, allLayers, buffer.closeEntries);
+            buffer.nrOfEntries.push_back(static_cast<uint32_t>(buffer.closeEntries.size()));
+        }
+    });
+
+    uint32_t written = 0;
+
+    for (int32_t part = 0; part < nrOfParts; part++)
+    {
+        const QueryBufferType& buffer = (*jobBuffers)[part];
+
+        uint32_t from = 0;
+        for (size_t j = 0; j != buffer.nrOfEntries.size(); j++)
+        {
+            const uint32_t size = buffer.nrOfEntries[j] - from;
+            const int32_t i = partStart(part) + static_cast<int32_t>(j);
+
+            if (size > capacity - written)
+            {
+                return SearchResult{ static_cast<uint32_t>(i), written, 1 };
+            }
+
+            std::copy(buffer.closeEntries.begin() + from, buffer.closeEntries.begin() + buffer.nrOfEntries[j], outCloseEntries + written);
+            written += size;
+            outNrOfEntries[i] = written;
+            from = buffer.nrOfEntries[j];
+        }
+    }
+
+    return SearchResult{ static_cast<uint32_t>(nrSearches), written, 0 };
+}
+
+/// <summary>
+/// Submits UpdateTable() to the job queue.
+/// </summary>
+/// <returns>The ticket of the job.</returns>
+template<uint32_t Dim, typename Scalar>
+uint64_t BasicSpatialHash<Dim, Scalar>::SubmitUpdateTable()
+{
+    return jobQueue->Submit([this] { UpdateTable(); });
+}
+
+/// <summary>
+/// Submits UpdateEntriesBulk() to the job queue.
+/// </summary>
+/// <param name="nrOfEntriesToUpdate">Number of entries that have moved.</param>
+/// <param name="ids">Ids of the entries, kept until the job is done.</param>
+/// <param name="positions">The new positions of the entries, kept until the job is done.</param>
+/// <returns>The ticket of the job.</returns>
+template<uint32_t Dim, typename Scalar>
+uint64_t BasicSpatialHash<Dim, Scalar>::SubmitUpdateEntries(uint32_t nrOfEntriesToUpdate, const uint32_t* ids, const PositionType* positions)
+{
+    return jobQueue->Submit([=] { UpdateEntriesBulk(nrOfEntriesToUpdate, ids, positions); });
+}
+
+/// <summary>
+/// Submits a bulk search to the job queue. The job runs GetCloseEntriesIntoSplit(), straight into the caller's
+/// buffers, so it doesn't use the buffers of the Spatial Hash that the caller's own searches use.
+/// </summary>
+/// <param name="nrSearches">How many searches that are bunched together.</param>
+/// <param name="pos">An array of postions, nrSearches long, kept until the job is done.</param>
+/// <param name="d">Distance in which entries are considered close.</param>
+/// <param name="maxEntities">Max number of entries per search to return.</param>
+/// <param name="outNrOfEntries">Gets where the results of every search end in outCloseEntries.</param>
+/// <param name="outCloseEntries">Gets the results.</param>
+/// <param name="capacity">The number of IdWithDistance:s outCloseEntries has room for.</param>
+/// <param name="outResult">Gets how many searches were done, how many entries were written and if the buffer was too small.</param>
+/// <returns>The ticket of the job.</returns>
+template<uint32_t Dim, typename Scalar>
+uint64_t BasicSpatialHash<Dim, Scalar>::SubmitCloseEntriesInto(int32_t nrSearches, PositionType* pos, float d, int32_t maxEntities, uint32_t* outNrOfEntries, IdWithDistance* outCloseEntries, uint32_t capacity, SearchResult* outResult)
+{
+    return jobQueue->Submit([=]
+    {
+        *outResult = GetCloseEntriesIntoSplit(nrSearches, pos, d, maxEntities, outNrOfEntries, outCloseEntries, capacity);
+    });
+}
+
+/// <summary>
+/// If a submitted job is done. The jobs are done in order, so every job before it is done as well.
+/// </summary>
+/// <param name="ticket">From one of the Submit functions.</param>
+/// <returns>True when the job is done.</returns>
+template<uint32_t Dim, typename Scalar>
+bool BasicSpatialHash<Dim, Scalar>::IsJobDone(uint64_t ticket) const
+{
+    return jobQueue->IsDone(ticket);
+}
+
+/// <summary>
+/// Waits for a submitted job to be done, and with it every job submitted before it.
+/// </summary>
+/// <param name="ticket">From one of the Submit functions.</param>
+template<uint32_t Dim, typename Scalar>
+void BasicSpatialHash<Dim, Scalar>::WaitForJob(uint64_t ticket)
+{
+    jobQueue->Wait(ticket);
+}
+
+/// <summary>
+/// The largest distance the offsets reach. From a position the offsets reach every cell
+/// that is ringRadius cells away, so every entry that is closer than that many cell sizes,
+/// less the hysteresis that entries can be outside of their cells.
+/// </summary>
+/// <returns>The distance.</returns>
+template<uint32_t Dim, typename Scalar>
+float BasicSpatialHash<Dim, Scalar>::MaxSearchDistance() const
+{
+    return max(0.0f, ringRadius * CellSize() - hysteresis);
+}
+
+/// <summary>
+/// Runs the searches of a group of positions that are all in the same cell. They share the offsets of the cell,
+/// so each offset cell is visited once for the whole group and its entries are tested against every search
+/// in the group that can still find something there, while they are in the cache.
+/// </summary>
+/// <param name="storage">The generation of the cells to search.</param>
+/// <param name="cellNr">The cell all the positions are in.</param>
+/// <param name="nrInGroup">Number of positions in the group, they are in buffer.groupPositions.</param>
+/// <param name="d">Distance in which entries are considered close.</param>
+/// <param name="maxEntities">Max number of entries per search.</param>
+/// <param name="buffer">The results of search i of the group end up in buffer.groupFound[i], sorted by distance.</param>
+template<uint32_t Dim, typename Scalar>
+void BasicSpatialHash<Dim, Scalar>::GetCloseEntriesGroup(const CellStorageType& storage, uint32_t cellNr, uint32_t nrInGroup, float d, int32_t maxEntities, QueryBufferType& buffer)
+{
+    const PositionType* positions = buffer.groupPositions.data();
+
+    if (buffer.groupFound.size() < nrInGroup)
+    {
+        buffer.groupFound.resize(nrInGroup);
+    }
+
+    buffer.selections.clear();
+    buffer.fractions.resize(nrInGroup);
+    buffer.queries.resize(nrInGroup);
+
+    for (uint32_t q = 0; q < nrInGroup; q++)
+    {
+        buffer.groupFound[q].clear();
+        buffer.selections.emplace_back(buffer.groupFound[q], maxEntities, d);
+        buffer.fractions[q] = CellFractions(positions[q]);
+
+        for (uint32_t axis = 0; axis < Dim; axis++)
+        {
+            buffer.queries[q][axis] = positions[q][axis];
+        }
+    }
+
+    if (maxEntities <= 0)
+    {
+        return;
+    }
+
+    ClosestSelection* selections = buffer.selections.data();
+    const float squaredCellSize = static_cast<float>(1 / (invCellSize * invCellSize));
+    const OffsetStep* steps = stepLists->data();
+    const uint32_t nrOfSteps = static_cast<uint32_t>(offsetsToCalculate.size());
+
+    // Cells near the edges work out their offsets from the unlocalized ones.
+    const bool nearEdge = (*table)[cellNr].nearEdge;
+    const Key tableCell = nearEdge ? TableCoordinates(cellNr) : Key{};
+
+    for (uint32_t i = 0; i < nrOfSteps; i++)
+    {
+        // The group is done with the steps when none of its searches is.
+        float largestLimit = 0.0f;
+        for (uint32_t q = 0; q < nrInGroup; q++)
+        {
+            largestLimit = max(largestLimit, selections[q].Limit());
+        }
+
+        if (StepMinSquaredDistance(i) * squaredCellSize >= largestLimit)
+        {
+            break;
+        }
+
+        const int32_t* offsets = offsetArena->data() + steps[i].start;
+        const Key* cellOffsets = offsetsToCalculate[i].data();
+
+        SPATIALHASH_COUNT(
+            for (uint32_t q = 0; q < nrInGroup; q++)
+            {
+                selections[q].counters.stepsWalked++;
+            })
+
+        for (uint32_t j = 0; j < steps[i].count; j++)
+        {
+            uint32_t offsetCell = cellNr + offsets[j];
+
+            if (nearEdge && !OffsetCellNearEdge(tableCell, cellOffsets[j], offsetCell))
+            {
+                continue;
+            }
+
+            if (storage.cellCount[offsetCell] == 0)
+            {
+                continue;
+            }
+
+            for (uint32_t q = 0; q < nrInGroup; q++)
+            {
+                if (SquaredCellGap(cellOffsets[j], buffer.fractions[q]) * squaredCellSize < selections[q].Limit())
+                {
+                    GetCloseEntriesInCell(storage, offsetCell, buffer.queries[q].data(), selections[q]);
+                }
+                else
+                {
+                    SPATIALHASH_COUNT(selections[q].counters.cellsSkipped++;)
+                }
+            }
+        }
+    }
+
+    // Searches further than the offsets reach go on past them, one by one.
+    for (uint32_t q = 0; q < nrInGroup; q++)
+    {
+        GetCloseEntriesBeyondOffsets(storage, positions[q], buffer.queries[q].data(), selections[q]);
+    }
+
+    for (uint32_t q = 0; q < nrInGroup; q++)
+    {
+        selections[q].Finish();
+
+        SPATIALHASH_COUNT(statCounters->Add(selections[q].counters);)
+    }
+}
+
+/// <summary>
+/// Runs the searches [from, to) of the cell sorted order of a grouped bulk search. Searches next to each
+/// other in the order that are in the same cell are run as a group. The results are appended to found
+/// in the sorted order, and where the results of each search end to ends.
+/// </summary>
+/// <param name="storage">The generation of the cells to search.</param>
+/// <param name="from">First search, in the sorted order, to run.</param>
+/// <param name="to">One past the last search to run.</param>
+/// <param name="order">The cell of each search in the upper 32 bits and its index in the lower, sorted.</param>
+/// <param name="pos">All the positions of the bulk search.</param>
+/// <param name="d">Distance in which entries are considered close.</param>
+/// <param name="maxEntities">Max number of entries per search.</param>
+/// <param name="buffer">Where the results are put.</param>
+template<uint32_t Dim, typename Scalar>
+void BasicSpatialHash<Dim, Scalar>::GetCloseEntriesGroupedRange(const CellStorageType& storage, int32_t from, int32_t to, const uint64_t* order, PositionType* pos, float d, int32_t maxEntities, QueryBufferType& buffer)
+{
+    for (int32_t groupStart = from; groupStart < to;)
+    {
+        const uint32_t cellNr = static_cast<uint32_t>(order[groupStart] >> 32);
+
+        int32_t groupEnd = groupStart;
+        buffer.groupPositions.clear();
+        while (groupEnd < to && static_cast<uint32_t>(order[groupEnd] >> 32) == cellNr)
+        {
+            buffer.groupPositions.push_back(pos[static_cast<uint32_t>(order[groupEnd])]);
+            groupEnd++;
+        }
+
+        const uint32_t nrInGroup = static_cast<uint32_t>(groupEnd - groupStart);
+
+        // A search alone in its cell has nothing to share, so it's run straight into the results.
+        // Hashed buckets have no shared offsets, so their searches are run one by one as well.
+        if (nrInGroup == 1 || hashMode == HashMode::Hashed)
+        {
+            for (uint32_t q = 0; q < nrInGroup; q++)
+            {
+                GetCloseEntries(storage, buffer.groupPositions[q], d, maxEntities, allLayers, buffer.closeEntries);
+                buffer.nrOfEntries.push_back(static_cast<uint32_t>(buffer.closeEntries.size()));
+            }
+
+            groupStart = groupEnd;
+            continue;
+        }
+
+        GetCloseEntriesGroup(storage, cellNr, nrInGroup, d, maxEntities, buffer);
+
+        for (uint32_t q = 0; q < nrInGroup; q++)
+        {
+            buffer.closeEntries.insert(buffer.closeEntries.end(), buffer.groupFound[q].begin(), buffer.groupFound[q].end());
+            buffer.nrOfEntries.push_back(static_cast<uint32_t>(buffer.closeEntries.size()));
+        }
+
+        groupStart = groupEnd;
+    }
+}
+
+/// <summary>
+/// The same search as GetCloseEntriesBulk(), but the positions are first sorted by cell and the positions
+/// in the same cell are searched together, see GetCloseEntriesGroup(). Meant for positions that are
+/// clustered, like when the positions are those of the entries themselves. The results are returned
+/// in the order of the positions, just as from GetCloseEntriesBulk().
+/// </summary>
+/// <param name="nrSearches">How many searches that are bunched together.</param>
+/// <param name="pos">An array of postions, nrSearches long.</param>
+/// <param name="d">Distance in which entries are considered close.</param>
+/// <param name="maxEntities">Max number of entries per search to return.</param>
+/// <returns>The entries that are close to the positions and how many of them there are.</returns>
+template<uint32_t Dim, typename Scalar>
+CloseIdsAndNrOf BasicSpatialHash<Dim, Scalar>::GetCloseEntriesBulkGrouped(int32_t nrSearches, PositionType* pos, float d, int32_t maxEntities)
+{
+    // Below this many searches per thread it's not worth waking up the other threads.
+    constexpr int32_t minSearchesPerPart = 64;
+
+    SPATIALHASH_COUNT(PhaseTimer timer(*statCounters, Phase::Search);)
+
+    SetMaxSearchDistance(d);
+
+    const shared_ptr<const CellStorageType> generation = ReadCells();
+
+    closeEntries->clear();
+    nrOfEntries->clear();
+
+    if (nrSearches <= 0)
+    {
+        nrOfEntries->push_back(0);
+        return CloseIdsAndNrOf{ nrOfEntries->data(), closeEntries->data() };
+    }
+
+    // Sorting the cell together with the index keeps the searches in a cell in their original order.
+    searchOrder->resize(nrSearches);
+    for (int32_t i = 0; i < nrSearches; i++)
+    {
+        (*searchOrder)[i] = (static_cast<uint64_t>(CalculateCellNr(pos[i])) << 32) | static_cast<uint32_t>(i);
+    }
+
+    std::sort(searchOrder->begin(), searchOrder->end());
+
+    int32_t nrOfParts = max(1, min(static_cast<int32_t>(workers->NrOfWorkers()), nrSearches / minSearchesPerPart));
+
+    if (queryBuffers->size() < static_cast<size_t>(nrOfParts))
+    {
+        queryBuffers->resize(nrOfParts);
+    }
+
+    auto partStart = [nrSearches, nrOfParts](int32_t part)
+    {
+        return static_cast<int32_t>(static_cast<int64_t>(nrSearches) * part / nrOfParts);
+    };
+
+    workers->Run(nrOfParts, [&](uint32_t part)
+    {
+        QueryBufferType& buffer = (*queryBuffers)[part];
+        buffer.closeEntries.clear();
+        buffer.nrOfEntries.clear();
+
+        GetCloseEntriesGroupedRange(*generation, partStart(part), partStart(part + 1), searchOrder->data(), pos, d, maxEntities, buffer);
+    });
+
+    // The number of entries of every search, in the original order, then summed up into where each search ends.
+    nrOfEntries->resize(nrSearches);
+    for (int32_t part = 0; part < nrOfParts; part++)
+    {
+        const QueryBufferType& buffer = (*queryBuffers)[part];
+        uint32_t previousEnd = 0;
+
+        for (size_t i = 0; i != buffer.nrOfEntries.size(); i++)
+        {
+            (*nrOfEntries)[static_cast<uint32_t>((*searchOrder)[partStart(part) + i])] = buffer.nrOfEntries[i] - previousEnd;
+            previousEnd = buffer.nrOfEntries[i];
+        }
+    }
+
+    for (int32_t i = 1; i < nrSearches; i++)
+    {
+        (*nrOfEntries)[i] += (*nrOfEntries)[i - 1];
+    }
+
+    closeEntries->resize(nrOfEntries->back());
+
+    // Scatters the results of every search back to where it is in the original order.
+    workers->Run(nrOfParts, [&](uint32_t part)
+    {
+        const QueryBufferType& buffer = (*queryBuffers)[part];
+        uint32_t previousEnd = 0;
+
+        for (size_t i = 0; i != buffer.nrOfEntries.size(); i++)
+        {
+            uint32_t search = static_cast<uint32_t>((*searchOrder)[partStart(part) + i]);
+            uint32_t start = search == 0 ? 0 : (*nrOfEntries)[search - 1];
+
+            std::copy(buffer.closeEntries.begin() + previousEnd, buffer.closeEntries.begin() + buffer.nrOfEntries[i], closeEntries->begin() + start);
+            previousEnd = buffer.nrOfEntries[i];
+        }
+    });
+
+    return CloseIdsAndNrOf{ nrOfEntries->data(), closeEntries->data() };
+}
+
+/// <summary>
+/// Generates the offsets GetClosePairs() compares each cell with. An offset is only included if its
+/// cells can be closer than d, and of an offset and its opposite only one is included, since the pair
+/// of cells they connect is the same. The offsets are wrapped into the table, if the search reaches
+/// around the table several offsets end up as the same one and it is only included once.
+/// The offset to the cell itself is left out, it's handled separately.
+/// </summary>
+/// <param name="d">The distance of the search.</param>
+/// <param name="pairOffsets">Gets the offsets.</param>
+template<uint32_t Dim, typename Scalar>
+void BasicSpatialHash<Dim, Scalar>::GeneratePairOffsets(float d, vector<PairOffset<Dim>>& pairOffsets)
+{
+    const int32_t side = static_cast<int32_t>(sideLength);
+    const float cellsPerDistance = static_cast<float>(invCellSize);
+    // Both entries of a pair can be up to the hysteresis outside of their cells.
+    const int32_t radius = static_cast<int32_t>(ceilf(d * cellsPerDistance + 2 * hysteresisInCells));
+    const float squaredRadius = d * cellsPerDistance * d * cellsPerDistance;
+
+    pairOffsets.clear();
+
+    // Hashed cells don't wrap, half of the offsets are the ones after the cell itself in row order,
+    // those where the last axis that isn't zero is positive.
+    if (hashMode == HashMode::Hashed)
+    {
+        ForEachCombination<Dim>(Range(-radius, radius), [&](const Key& offset)
+        {
+            int32_t lastNonZero = 0;
+            float squaredGap = 0.0f;
+
+            for (uint32_t axis = 0; axis < Dim; axis++)
+            {
+                float gap = max(0.0f, abs(offset[axis]) - 1.0f);
+                squaredGap += gap * gap;
+                lastNonZero = offset[axis] != 0 ? offset[axis] : lastNonZero;
+            }
+
+            if (lastNonZero > 0 && squaredGap < squaredRadius)
+            {
+                pairOffsets.push_back(PairOffset<Dim>{ offset, false });
+            }
+        });
+
+        return;
+    }
+
+    // Every wrapped offset along one side once, with the offset of the smallest size that wraps to it.
+    vector<int32_t> sideOffsets;
+    if (2 * radius + 1 < side)
+    {
+        sideOffsets = Range(-radius, radius);
+    }
+    else
+    {
+        for (int32_t offset = 0; offset < side; offset++)
+        {
+            sideOffsets.push_back(2 * offset <= side ? offset : offset - side);
+        }
+    }
+
+    ForEachCombination<Dim>(sideOffsets, [&](const Key& offset)
+    {
+        float squaredGap = 0.0f;
+        Key wrapped;
+        Key opposite;
+
+        for (uint32_t axis = 0; axis < Dim; axis++)
+        {
+            // Number of whole cells between the two cells.
+            float gap = max(0.0f, abs(offset[axis]) - 1 - 2 * hysteresisInCells);
+            squaredGap += gap * gap;
+
+            wrapped[axis] = static_cast<int32_t>(static_cast<uint32_t>(offset[axis]) & mask);
+            opposite[axis] = static_cast<int32_t>(static_cast<uint32_t>(-offset[axis]) & mask);
+        }
+
+        const uint32_t offsetNr = TableCellNr(wrapped);
+        const uint32_t oppositeNr = TableCellNr(opposite);
+
+        if (squaredGap < squaredRadius && offsetNr != 0 && offsetNr <= oppositeNr)
+        {
+            pairOffsets.push_back(PairOffset<Dim>{ wrapped, offsetNr == oppositeNr });
+        }
+    });
+}
+
+/// <summary>
+/// Finds the close pairs where the first entry is in one of the cells [from, to). Entries in the same
+/// cell are compared with the entries after them in the cell, and with all the entries in the cells of pairOffsets.
+/// </summary>
+/// <param name="storage">The generation of the cells.</param>
+/// <param name="from">The first cell.</param>
+/// <param name="to">One past the last cell.</param>
+/// <param name="d">The distance the entries of a pair have to be closer than.</param>
+/// <param name="pairOffsets">From GeneratePairOffsets().</param>
+/// <param name="pairs">The pairs found are appended here.</param>
+template<uint32_t Dim, typename Scalar>
+void BasicSpatialHash<Dim, Scalar>::GetClosePairsInCells(const CellStorageType& storage, uint32_t from, uint32_t to, float d, const vector<PairOffset<Dim>>& pairOffsets, vector<IdPair>& pairs)
+{
+    const Scalar dSquared = static_cast<Scalar>(d) * d;
+    const uint32_t* ids = storage.ids.data();
+
+    for (uint32_t cellNr = from; cellNr < to; cellNr++)
+    {
+        const uint32_t start = storage.cellStart[cellNr];
+        const uint32_t count = storage.cellCount[cellNr];
+
+        if (count == 0)
+        {
+            continue;
+        }
+
+        const Key tableCell = TableCoordinates(cellNr);
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            const uint32_t id = ids[start + i];
+            const uint32_t others = start + i + 1;
+
+            Scalar query[Dim];
+            StoredPosition(storage, start + i, query);
+
+            FindStoredWithinDistance(storage, cellNr, others, count - i - 1, query, dSquared, allLayers,
+                [&](uint32_t m, float squaredDistance)
+            {
+                pairs.push_back(IdPair(id, ids[others + m], sqrtf(squaredDistance)));
+            });
+        }
+
+        for (const PairOffset<Dim>& pairOffset : pairOffsets)
+        {
+            Key other;
+            for (uint32_t axis = 0; axis < Dim; axis++)
+            {
+                other[axis] = static_cast<int32_t>(static_cast<uint32_t>(tableCell[axis] + pairOffset.offset[axis]) & mask);
+            }
+
+            uint32_t otherCell = TableCellNr(other);
+
+            if (pairOffset.selfInverse && otherCell < cellNr)
+            {
+                continue;
+            }
+
+            const uint32_t otherStart = storage.cellStart[otherCell];
+            const uint32_t otherCount = storage.cellCount[otherCell];
+
+            for (uint32_t i = 0; i < otherCount; i++)
+            {
+                const uint32_t otherId = ids[otherStart + i];
+
+                Scalar query[Dim];
+                StoredPosition(storage, otherStart + i, query);
+
+                FindStoredWithinDistance(storage, cellNr, start, count, query, dSquared, allLayers,
+                    [&](uint32_t m, float squaredDistance)
+                {
+                    pairs.push_back(IdPair(ids[start + m], otherId, sqrtf(squaredDistance)));
+                });
+            }
+        }
+    }
+}
+
+/// <summary>
+/// GetClosePairsInCells() for HashMode::Hashed. The cell of the world of every entry is worked out and
+/// the offsets are added to it, since the neighbours of a bucket aren't any particular buckets. Only
+/// the entries of the bucket that are from the offset cell are paired with, so that every pair is found once.
+/// </summary>
+/// <param name="storage">The generation of the cells.</param>
+/// <param name="from">The first bucket.</param>
+/// <param name="to">One past the last bucket.</param>
+/// <param name="d">The distance the entries of a pair have to be closer than.</param>
+/// <param name="pairOffsets">From GeneratePairOffsets(), offsets between cells of the world.</param>
+/// <param name="pairs">The pairs found are appended here.</param>
+template<uint32_t Dim, typename Scalar>
+void BasicSpatialHash<Dim, Scalar>::GetClosePairsInHashedCells(const CellStorageType& storage, uint32_t from, uint32_t to, float d, const vector<PairOffset<Dim>>& pairOffsets, vector<IdPair>& pairs)
+{
+    const Scalar dSquared = static_cast<Scalar>(d) * d;
+    const uint32_t* ids = storage.ids.data();
+
+    for (uint32_t bucket = from; bucket < to; bucket++)
+    {
+        const uint32_t start = storage.cellStart[bucket];
+        const uint32_t count = storage.cellCount[bucket];
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            const uint32_t id = ids[start + i];
+            const Key cell = StoredCell(storage, start + i);
+
+            Scalar query[Dim];
+            StoredPosition(storage, start + i, query);
+
+            // Pairs with the entries after it in the bucket that are from the same cell.
+            const uint32_t others = start + i + 1;
+
+            FindStoredWithinDistance(storage, bucket, others, count - i - 1, query, dSquared, allLayers,
+                [&](uint32_t m, float squaredDistance)
+            {
+                if (StoredCell(storage, others + m) == cell)
+                {
+                    pairs.push_back(IdPair(id, ids[others + m], sqrtf(squaredDistance)));
+                }
+            });
+
+            for (const PairOffset<Dim>& pairOffset : pairOffsets)
+            {
+                Key wanted = cell;
+                for (uint32_t axis = 0; axis < Dim; axis++)
+                {
+                    wanted[axis] += pairOffset.offset[axis];
+                }
+
+                const uint32_t otherBucket = HashCell(wanted);
+                const uint32_t otherStart = storage.cellStart[otherBucket];
+                const bool mixed = storage.mixed[otherBucket] != 0;
+
+                if (storage.cellCount[otherBucket] == 0 || (!mixed && storage.tags[otherBucket] != wanted))
+                {
+                    continue;
+                }
+
+                FindStoredWithinDistance(storage, otherBucket, otherStart, storage.cellCount[otherBucket], query, dSquared, allLayers,
+                    [&](uint32_t m, float squaredDistance)
+                {
+                    if (!mixed || StoredCell(storage, otherStart + m) == wanted)
+                    {
+                        pairs.push_back(IdPair(id, ids[otherStart + m], sqrtf(squaredDistance)));
+                    }
+                });
+            }
+        }
+    }
+}
+
+/// <summary>
+/// Finds every pair of entries that are closer than d to each other, see FindClosePairs().
+/// </summary>
+/// <param name="d">The distance the entries of a pair have to be closer than.</param>
+/// <returns>The pairs and how many they are.</returns>
+template<uint32_t Dim, typename Scalar>
+ClosePairsAndNrOf BasicSpatialHash<Dim, Scalar>::GetClosePairs(float d)
+{
+    FindClosePairs(*ReadCells(), d);
+
+    return ClosePairsAndNrOf{ static_cast<uint32_t>(closePairs->size()), closePairs->data() };
+}
+
+/// <summary>
+/// Finds every pair of entries that are closer than d to each other into closePairs. The cells are split into
+/// contiguous blocks that are searched in parallel, each into its own list, which are then joined.
+/// </summary>
+/// <param name="storage">The generation of the cells to search.</param>
+/// <param name="d">The distance the entries of a pair have to be closer than.</param>
+template<uint32_t Dim, typename Scalar>
+void BasicSpatialHash<Dim, Scalar>::FindClosePairs(const CellStorageType& storage, float d)
+{
+    // Below this many entries per thread it's not worth waking up the other threads.
+    constexpr uint32_t minEntriesPerPart = 4096;
+
+    SPATIALHASH_COUNT(PhaseTimer timer(*statCounters, Phase::Pairs);)
+
+    vector<PairOffset<Dim>> pairOffsets;
+    GeneratePairOffsets(d, pairOffsets);
+
+    const bool hashed = hashMode == HashMode::Hashed;
+
+    const uint32_t nrOfCells = static_cast<uint32_t>(table->size());
+    const uint32_t nrOfParts = max(1u, min(workers->NrOfWorkers(), storage.numberOfIds / minEntriesPerPart));
+
+    if (pairBuffers->size() < nrOfParts)
+    {
+        pairBuffers->resize(nrOfParts);
+    }
+
+    workers->Run(nrOfParts, [&](uint32_t part)
+    {
+        uint32_t from = static_cast<uint32_t>(static_cast<uint64_t>(nrOfCells) * part / nrOfParts);
+        uint32_t to = static_cast<uint32_t>(static_cast<uint64_t>(nrOfCells) * (part + 1) / nrOfParts);
+
+        (*pairBuffers)[part].clear();
+
+        if (hashed)
+        {
+            GetClosePairsInHashedCells(storage, from, to, d, pairOffsets, (*pairBuffers)[part]);
+        }
+        else
+        {
+            GetClosePairsInCells(storage, from, to, d, pairOffsets, (*pairBuffers)[part]);
+        }
+    });
+
+    closePairs->clear();
+    for (uint32_t part = 0; part < nrOfParts; part++)
+    {
+        closePairs->insert(closePairs->end(), (*pairBuffers)[part].begin(), (*pairBuffers)[part].end());
+    }
+}
+
+/// <summary>
+/// Turns the pairs from GetClosePairs() into a list of neighbours per id, with a counting sort over the ids.
+/// </summary>
+/// <param name="d">The distance the neighbours have to be closer than.</param>
+/// <returns>The neighbours of every id and where they end.</returns>
+template<uint32_t Dim, typename Scalar>
+CloseIdsAndNrOf BasicSpatialHash<Dim, Scalar>::GetNeighboursOfAll(float d)
+{
+    // The ids of the pairs are those of the cells they were found in, an insert meanwhile can add more.
+    const shared_ptr<const CellStorageType> generation = ReadCells();
+    const uint32_t numberOfIds = generation->numberOfIds;
+
+    FindClosePairs(*generation, d);
+
+    closeEntries->resize(closePairs->size() * 2);
+    nrOfEntries->assign(numberOfIds + 1, 0);
+
+    // Counts into the element after each id so that the prefix sum gives where each id starts.
+    for (const IdPair& pair : *closePairs)
+    {
+        (*nrOfEntries)[pair.first + 1]++;
+        (*nrOfEntries)[pair.second + 1]++;
+    }
+
+    for (uint32_t id = 0; id < numberOfIds; id++)
+    {
+        (*nrOfEntries)[id + 1] += (*nrOfEntries)[id];
+    }
+
+    // Filling in moves each start forward to where the id ends, which is what is returned.
+    for (const IdPair& pair : *closePairs)
+    {
+        (*closeEntries)[(*nrOfEntries)[pair.first]++] = IdWithDistance(pair.second, pair.distance);
+        (*closeEntries)[(*nrOfEntries)[pair.second]++] = IdWithDistance(pair.first, pair.distance);
+    }
+
+    return CloseIdsAndNrOf{ nrOfEntries->data(), closeEntries->data() };
+}
+
+/// <summary>
+/// Calculates the localized offsets from the unlocalized offsets generated by GenerateOffsets(). Offsets only differ
+/// between cells where they wrap around the edges of the table, or leave a bounded one, so all the cells far enough
+/// from the edges share one list that is calculated from the first of them. The cells near the edges are only marked,
+/// their offsets are worked out while searching, see OffsetCellNearEdge(). Offsets calculated earlier are thrown away first.
+/// </summary>
+template<uint32_t Dim, typename Scalar>
+void BasicSpatialHash<Dim, Scalar>::InitializeOffsets()
+{
+    offsetArena->clear();
+    stepLists->clear();
+
+    GenerateOffsets();
+
+    // Hashed buckets have no neighbouring buckets, the offsets are added to the cells of the world instead.
+    if (hashMode == HashMode::Hashed)
+    {
+        return;
+    }
+
+    // All cells this far from the edges have the same offsets.
+    const int32_t interiorFirst = ringRadius;
+    const int32_t interiorEnd = static_cast<int32_t>(sideLength) - ringRadius;
+
+    Key interiorCell;
+    for (uint32_t axis = 0; axis < Dim; axis++)
+    {
+        interiorCell[axis] = interiorFirst;
+    }
+
+    const uint32_t interiorCellNr = TableCellNr(interiorCell);
+
+    for (const vector<Key>& stepOffsets : offsetsToCalculate)
+    {
+        stepLists->push_back(OffsetStep{ static_cast<uint32_t>(offsetArena->size()), static_cast<uint32_t>(stepOffsets.size()) });
+
+        for (const Key& offset : stepOffsets)
+        {
+            Key target;
+            for (uint32_t axis = 0; axis < Dim; axis++)
+            {
+                target[axis] = static_cast<int32_t>(static_cast<uint32_t>(interiorCell[axis] + offset[axis]) & mask);
+            }
+
+            offsetArena->push_back(static_cast<int32_t>(TableCellNr(target) - interiorCellNr));
+        }
+    }
+
+    for (uint32_t cellNr = 0; cellNr != static_cast<uint32_t>(table->size()); cellNr++)
+    {
+        const Key tableCell = TableCoordinates(cellNr);
+
+        bool interior = true;
+        for (uint32_t axis = 0; axis < Dim; axis++)
+        {
+            interior = interior && tableCell[axis] >= interiorFirst && tableCell[axis] < interiorEnd;
+        }
+
+        (*table)[cellNr].nearEdge = !interior;
+    }
+}
+
+/// <summary>
+/// The cell at an unlocalized offset from a cell near the edges of the table, where the shared offsets don't
+/// apply. The offset is wrapped around the table, and in a bounded table cells outside of it are left out.
+/// </summary>
+/// <param name="tableCell">The coordinates of the cell in the table.</param>
+/// <param name="offset">The unlocalized offset.</param>
+/// <param name="offsetCell">Gets the number of the cell at the offset.</param>
+/// <returns>False if the offset leaves a bounded table.</returns>
+template<uint32_t Dim, typename Scalar>
+inline bool BasicSpatialHash<Dim, Scalar>::OffsetCellNearEdge(const Key& tableCell, const Key& offset, uint32_t& offsetCell) const
+{
+    Key target;
+    for (uint32_t axis = 0; axis < Dim; axis++)
+    {
+        target[axis] = tableCell[axis] + offset[axis];
+
+        if (hashMode == HashMode::Bounded && static_cast<uint32_t>(target[axis]) >= sideLength)
+        {
+            return false;
+        }
+
+        target[axis] = static_cast<int32_t>(static_cast<uint32_t>(target[axis]) & mask);
+    }
+
+    offsetCell = TableCellNr(target);
+    return true;
+}
+
+/// <summary>
+/// Generates the unlocalized offsets of all the cells within ringRadius cells of a cell, in every direction.
+/// The offsets are grouped into steps, rings, of cells that have the same minimum possible distance to the
+/// cell in the middle, and the steps are sorted by that distance. Measured in cells the minimum distance
+/// to the cell at (dx, dy) is the length of (max(0, |dx| - 1), max(0, |dy| - 1)), and the same with dz in 3d,
+/// so the first step is the middle cell and its neighbours.
+/// </summary>
+template<uint32_t Dim, typename Scalar>
+void BasicSpatialHash<Dim, Scalar>::GenerateOffsets()
+{
+    struct RingOffset
+    {
+        int32_t squaredDistance;
+        Key offset;
+    };
+
+    vector<RingOffset> ringOffsets;
+    ringOffsets.reserve(static_cast<size_t>(pow(2 * ringRadius + 1, Dim)));
+
+    ForEachCombination<Dim>(Range(-ringRadius, ringRadius), [&](const Key& offset)
+    {
+        int32_t squaredDistance = 0;
+        for (uint32_t axis = 0; axis < Dim; axis++)
+        {
+            int32_t gap = max(0, abs(offset[axis]) - 1);
+            squaredDistance += gap * gap;
+        }
+
+        ringOffsets.push_back(RingOffset{ squaredDistance, offset });
+    });
+
+    stable_sort(ringOffsets.begin(), ringOffsets.end(), [](const RingOffset& a, const RingOffset& b) { return a.squaredDistance < b.squaredDistance; });
+
+    offsetsToCalculate.clear();
+    stepMinSquaredDistances->clear();
+
+    for (size_t i = 0; i != ringOffsets.size(); i++)
+    {
+        if (i == 0 || ringOffsets[i].squaredDistance != ringOffsets[i - 1].squaredDistance)
+        {
+            offsetsToCalculate.emplace_back();
+            stepMinSquaredDistances->push_back(static_cast<float>(ringOffsets[i].squaredDistance));
+        }
+
+        offsetsToCalculate.back().push_back(ringOffsets[i].offset);
+    }
+}
+
+/// <summary>
+/// Makes sure that the offsets reach far enough for a search distance. If they don't,
+/// the ring radius is increased and the offsets are calculated again.
+/// </summary>
+/// <param name="d">The largest distance that is going to be searched.</param>
+template<uint32_t Dim, typename Scalar>
+void BasicSpatialHash<Dim, Scalar>::SetMaxSearchDistance(float d)
+{
+    if (ExtendRings(d))
+    {
+        InitializeOffsets();
+    }
+}
+
+/// <summary>
+/// The largest ring radius. In a wrapped table a larger radius would wrap around and visit cells twice. A bounded
+/// table is kept to the same, so that there are cells that share the offsets, and searches further than that go on
+/// ring by ring past them. Hashed cells have no limit.
+/// </summary>
+template<uint32_t Dim, typename Scalar>
+int32_t BasicSpatialHash<Dim, Scalar>::MaxRingRadius() const
+{
+    if (hashMode == HashMode::Hashed)
+    {
+        return numeric_limits<int32_t>::max() / 4;
+    }
+
+    return static_cast<int32_t>(sideLength - 1) / 2;
+}
+
+/// <summary>
+/// Sets how the cells of the world are put into the table. The entries are sorted into their cells again.
+/// Hashed cells don't use hysteresis, since buckets are tagged with the cell their entries are in.
+/// </summary>
+/// <param name="mode">The hash mode.</param>
+/// <param name="inOrigin">Where the cells start, for a bounded table its lowest corner.</param>
+template<uint32_t Dim, typename Scalar>
+void BasicSpatialHash<Dim, Scalar>::SetHashMode(HashMode mode, PositionType inOrigin)
+{
+    hashMode = mode;
+    origin = inOrigin;
+
+    if (hashMode == HashMode::Hashed)
+    {
+        hysteresis = 0.0f;
+        hysteresisInCells = 0.0f;
+    }
+
+    ringRadius = min(1, MaxRingRadius());
+    InitializeOffsets();
+
+    if (numberOfAllEntries != 0)
+    {
+        BeginCellsUpdate();
+
+        for (uint32_t i = 0; i < numberOfAllEntries; i++)
+        {
+            EnteredType& entered = (*allEntered)[i];
+
+            if (entered.hashValue != removedHashValue)
+            {
+                entered.hashValue = CalculateCellNr(entered.entry.position);
+            }
+        }
+
+        RebuildCells();
+        PublishCells();
+    }
+}
+
+/// <summary>
+/// Counts how many cells of the table hold entries from more than one cell of the world. Those entries
+/// are tested by searches from all of those cells, and rejected by distance from all but one.
+/// </summary>
+/// <returns>The counts.</returns>
+template<uint32_t Dim, typename Scalar>
+AliasingStats BasicSpatialHash<Dim, Scalar>::GetAliasingStats() const
+{
+    AliasingStats stats{};
+    vector<Key> worldCells;
+
+    const shared_ptr<const CellStorageType> generation = ReadCells();
+    const CellStorageType& storage = *generation;
+
+    for (uint32_t cellNr = 0; cellNr < static_cast<uint32_t>(table->size()); cellNr++)
+    {
+        const uint32_t start = storage.cellStart[cellNr];
+        const uint32_t count = storage.cellCount[cellNr];
+
+        if (count == 0)
+        {
+            continue;
+        }
+
+        worldCells.clear();
+        for (uint32_t i = start; i < start + count; i++)
+        {
+            worldCells.push_back(StoredCell(storage, i));
+        }
+
+        sort(worldCells.begin(), worldCells.end());
+        uint32_t nrOfWorldCells = static_cast<uint32_t>(unique(worldCells.begin(), worldCells.end()) - worldCells.begin());
+
+        stats.occupiedCells++;
+        stats.worldCells += nrOfWorldCells;
+
+        if (nrOfWorldCells > 1)
+        {
+            stats.aliasedCells++;
+            stats.entriesInAliasedCells += count;
+        }
+    }
+
+    return stats;
+}
+
+/// <summary>
+/// Fills stats with the counters and timers, and counts how many entries the cells hold.
+/// Every bin of the occupancy histogram is twice as wide as the one before it.
+/// </summary>
+/// <param name="stats">Gets the stats.</param>
+/// <param name="reset">If the counters and timers are set to zero afterwards.</param>
+template<uint32_t Dim, typename Scalar>
+void BasicSpatialHash<Dim, Scalar>::GetStats(SpatialHashStats& stats, bool reset)
+{
+    stats = SpatialHashStats{};
+
+#if defined(SPATIALHASH_STATS)
+    auto Milliseconds = [this](Phase phase)
+    {
+        return statCounters->phaseNanoseconds[static_cast<uint32_t>(phase)].load(memory_order_relaxed) / 1e6;
+    };
+
+    stats.enabled = 1;
+    stats.searches = statCounters->searches;
+    stats.stepsWalked = statCounters->stepsWalked;
+    stats.cellsVisited = statCounters->cellsVisited;
+    stats.cellsSkipped = statCounters->cellsSkipped;
+    stats.candidatesTested = statCounters->candidatesTested;
+    stats.hits = statCounters->hits;
+    stats.rejectedByDistance = stats.candidatesTested - stats.hits;
+    stats.aliasingRejections = statCounters->aliasingRejections;
+    stats.updates = statCounters->updates;
+    stats.migrations = statCounters->migrations;
+    stats.rebuilds = statCounters->rebuilds;
+    stats.updateMs = Milliseconds(Phase::Update);
+    stats.searchMs = Milliseconds(Phase::Search);
+    stats.pairsMs = Milliseconds(Phase::Pairs);
+    stats.rebuildMs = Milliseconds(Phase::Rebuild);
+
+    if (reset)
+    {
+        statCounters->Reset();
+    }
+#else
+    // Nothing is counted, so there is nothing to reset.
+    (void)reset;
+#endif
+
+    const shared_ptr<const CellStorageType> generation = ReadCells();
+
+    for (uint32_t cellNr = 0; cellNr < static_cast<uint32_t>(table->size()); cellNr++)
+    {
+        const uint32_t count = generation->cellCount[cellNr];
+
+        uint32_t bin = 0;
+        while (bin + 1 < occupancyBins && count >= (1u << bin))
+        {
+            bin++;
+        }
+
+        stats.occupancy[bin]++;
+        stats.maxOccupancy = max(stats.maxOccupancy, count);
+    }
+}
+
+/// <summary>
+/// Increases the ring radius so that the offsets reach a search distance, without calculating them again.
+/// </summary>
+/// <param name="d">The distance the offsets should reach.</param>
+/// <returns>True if the ring radius changed and the offsets need to be calculated again.</returns>
+template<uint32_t Dim, typename Scalar>
+bool BasicSpatialHash<Dim, Scalar>::ExtendRings(float d)
+{
+    const int32_t maxRingRadius = MaxRingRadius();
+
+    // Entries can be up to the hysteresis outside of their cells.
+    const float neededRings = ceil((d + hysteresis) * static_cast<float>(invCellSize));
+
+    /* Searches further than the largest ring radius go on past the offsets, in one pass over the table once the
+    rings wrap around it. The table keeps to the largest radius, hashed cells have no table to keep to. */
+    if (neededRings > static_cast<float>(maxRingRadius))
+    {
+        if (hashMode != HashMode::Hashed && ringRadius < maxRingRadius)
+        {
+            ringRadius = maxRingRadius;
+            return true;
+        }
+
+        return false;
+    }
+
+    const int32_t neededRingRadius = static_cast<int32_t>(neededRings);
+
+    if (neededRingRadius > ringRadius)
+    {
+        ringRadius = neededRingRadius;
+        return true;
+    }
+
+    return false;
+}
+
+/// <summary>
+/// Sets how large the table is and how large its cells are. The cells are emptied and the
+/// offsets have to be initialized again, so this is only done before the entries are added.
+/// </summary>
+/// <param name="sidePower">The table will be 2^sidePower cells along every dimension.</param>
+/// <param name="cellSize">The side length of a cell, 0 or less for cells as wide as the table is in cells.</param>
+template<uint32_t Dim, typename Scalar>
+void BasicSpatialHash<Dim, Scalar>::Resize(uint32_t sidePower, float cellSize)
+{
+    sideLength = 1u << sidePower;
+    mask = sideLength - 1;
+    invCellSize = cellSize > 0.0f ? 1 / static_cast<Scalar>(cellSize) : 1 / static_cast<Scalar>(sideLength);
+
+    // The hysteresis has to stay below half a cell.
+    hysteresis = min(hysteresis, 0.49f * CellSize());
+    hysteresisInCells = hysteresis * static_cast<float>(invCellSize);
+
+    // Enough for searches up to one cell away, SetMaxSearchDistance() or larger searches increase it.
+    ringRadius = min(1, MaxRingRadius());
+
+    table->assign(static_cast<size_t>(pow(sideLength, Dim)), Cell());
+
+    // The entries are sorted into the cells with a counting sort, so every cell needs a start index.
+    cells->cellStart.assign(table->size() + 1, 0);
+    cells->cellCount.assign(table->size(), 0);
+    cells->tags.assign(table->size(), Key{});
+    cells->mixed.assign(table->size(), 0);
+}
+
+/// <summary>
+/// Picks a cell size and table size for entries and an expected search distance. The density of the
+/// entries is estimated from a sample of them. A search visits about (2r / c + 1)^Dim
+/// cells of size c, and tests the entries of a ball with radius r + c / 2, pi / 4 * (2r + c)^2 of area in 2d.
+/// Small cells mean few tested entries but many visited cells, so the cell size with the lowest sum is used.
+/// The table is made large enough to cover the bounding box without wrapping, but not much larger than there are entries.
+/// </summary>
+/// <param name="entries">The entries that are going to be added.</param>
+/// <param name="numberOfEntries">The number of entries.</param>
+template<uint32_t Dim, typename Scalar>
+void BasicSpatialHash<Dim, Scalar>::AutoTune(const EntryType* entries, uint32_t numberOfEntries)
+{
+    // Visiting a cell costs about as much as testing this many entries.
+    constexpr float cellCost = 8.0f;
+    constexpr uint32_t maxSamples = 4096;
+    constexpr uint32_t maxSidePower = 24 / Dim;
+    constexpr uint32_t maxCellsPerEntry = 4;
+    constexpr float pi = 3.14159265f;
+
+    // The volume of a ball with radius 1, a circle in 2d.
+    const float unitBall = Dim == 2 ? pi : 4.0f / 3.0f * pi;
+
+    const float r = autoTuneDistance;
+
+    if (r <= 0.0f || numberOfEntries == 0)
+    {
+        return;
+    }
+
+    const uint32_t sampleStep = max(1u, numberOfEntries / maxSamples);
+
+    Scalar lowest[Dim];
+    Scalar highest[Dim];
+    for (uint32_t axis = 0; axis < Dim; axis++)
+    {
+        lowest[axis] = entries[0].position[axis];
+        highest[axis] = lowest[axis];
+    }
+
+    for (uint32_t i = 0; i < numberOfEntries; i += sampleStep)
+    {
+        for (uint32_t axis = 0; axis < Dim; axis++)
+        {
+            lowest[axis] = min(lowest[axis], entries[i].position[axis]);
+            highest[axis] = max(highest[axis], entries[i].position[axis]);
+        }
+    }
+
+    // A search reaches r from the edges, so the volume is at least that wide along every side.
+    float volume = 1.0f;
+    float longestSide = 0.0f;
+    for (uint32_t axis = 0; axis < Dim; axis++)
+    {
+        float extent = max(static_cast<float>(highest[axis] - lowest[axis]), r);
+        volume *= extent;
+        longestSide = max(longestSide, extent);
+    }
+
+    /* Clustered entries are denser around the entries than over the bounding box. The samples are counted
+     * in squares, or cubes, 4r wide, and for a sample the other samples in its square are on average
+     * sum(n * (n - 1)) / sum(n), which is scaled up to all the entries. */
+    const float squareSize = 4 * r;
+    unordered_map<uint64_t, uint32_t> squares;
+    uint32_t nrOfSamples = 0;
+
+    for (uint32_t i = 0; i < numberOfEntries; i += sampleStep)
+    {
+        // The squares along every axis are packed into 64 bits, squares sharing a key only make the estimate a bit denser.
+        uint64_t square = 0;
+        for (uint32_t axis = 0; axis < Dim; axis++)
+        {
+            square = (square << (64 / Dim)) | static_cast<uint64_t>((entries[i].position[axis] - lowest[axis]) / squareSize);
+        }
+
+        squares[square]++;
+        nrOfSamples++;
+    }
+
+    double othersInSquare = 0.0;
+    for (const auto& square : squares)
+    {
+        othersInSquare += static_cast<double>(square.second) * (square.second - 1);
+    }
+    othersInSquare = othersInSquare / nrOfSamples * numberOfEntries / nrOfSamples;
+
+    const float density = max(numberOfEntries / volume, static_cast<float>(othersInSquare) / powf(squareSize, Dim));
+
+    float bestCellSize = r;
+    float bestCost = numeric_limits<float>::max();
+
+    // Cell sizes from r / 8 to 4r, in steps of a fourth of a doubling.
+    for (int32_t step = -12; step <= 8; step++)
+    {
+        float c = r * exp2f(step / 4.0f);
+        float cellsVisited = powf(2 * r / c + 1, Dim);
+        float entriesTested = density * unitBall * powf(r + c / 2, Dim);
+        float cost = cellCost * cellsVisited + entriesTested;
+
+        if (cost < bestCost)
+        {
+            bestCost = cost;
+            bestCellSize = c;
+        }
+    }
+
+    uint32_t sidePower = 0;
+    while (sidePower < maxSidePower
+        && static_cast<float>(1u << sidePower) * bestCellSize < longestSide
+        && (1ull << (Dim * (sidePower + 1))) <= static_cast<uint64_t>(numberOfEntries) * maxCellsPerEntry)
+    {
+        sidePower++;
+    }
+
+    Resize(sidePower, bestCellSize);
+}
+
+/// <summary>
+/// Makes Initilize() pick the cell size and table size from the entries and an expected search distance,
+/// see AutoTune().
+/// </summary>
+/// <param name="expectedSearchDistance">The typical search distance, 0 turns the tuning off.</param>
+template<uint32_t Dim, typename Scalar>
+void BasicSpatialHash<Dim, Scalar>::SetAutoTune(float expectedSearchDistance)
+{
+    autoTuneDistance = max(0.0f, expectedSearchDistance);
+}
+
+/// <summary>
+/// The side length of the cells.
+/// </summary>
+template<uint32_t Dim, typename Scalar>
+float BasicSpatialHash<Dim, Scalar>::CellSize() const
+{
+    return static_cast<float>(1 / invCellSize);
+}
+
+/// <summary>
+/// The table is 2^SidePower() cells along every dimension.
+/// </summary>
+template<uint32_t Dim, typename Scalar>
+uint32_t BasicSpatialHash<Dim, Scalar>::SidePower() const
+{
+    uint32_t sidePower = 0;
+    while ((1u << sidePower) < sideLength)
+    {
+        sidePower++;
+    }
+
+    return sidePower;
+}
+
+// The configurations the Spatial Hash is built for, every one gets its own hot loops.
+template class BasicSpatialHash<2, float>;
+template class BasicSpatialHash<3, float>;
+template class BasicSpatialHash<2, double>;
+template class BasicSpatialHash<3, double>;
+
+/*-------------INTEROPS------------*/
+
+/// <summary>
+/// Instanciates a SpatialHash of a certain size.
+/// </summary>
+/// <param name="tableSize">The length and height of the table will be 2^tableSize.</param>
+/// <returns>A pointer to the instanciated SpatialHash.</returns>
+void* Start(uint32_t tableSize)
+{
+    SpatialHash* spatialHash = new SpatialHash(tableSize);
+
+    return spatialHash;
+}
+
+/// <summary>
+/// Instanciates a SpatialHash of a certain size with a certain cell size.
+/// </summary>
+/// <param name="tableSize">The length and height of the table will be 2^tableSize.</param>
+/// <param name="cellSize">The side length of the cells, 0 for cells as wide as the table is in cells.</param>
+/// <returns>A pointer to the instanciated SpatialHash.</returns>
+void* StartWithCellSize(uint32_t tableSize, float cellSize)
+{
+    SpatialHash* spatialHash = new SpatialHash(tableSize, cellSize);
+
+    return spatialHash;
+}
+
+/// <summary>
+/// Sets how cells of the world are put into the table of the Spatial Hash, see HashMode.
+/// </summary>
+/// <param name="mode">0 for Wrapped, 1 for Hashed and 2 for Bounded.</param>
+/// <param name="originX">Where the cells start horizontally, the left edge of a bounded world.</param>
+/// <param name="originY">Where the cells start vertically, the lower edge of a bounded world.</param>
+/// <param name="spatialHash">The Spatial Hash to set the mode of.</param>
+void SetHashMode(uint32_t mode, float originX, float originY, SpatialHash* spatialHash)
+{
+    spatialHash->SetHashMode(static_cast<HashMode>(mode), Position(originX, originY));
+}
+
+/// <summary>
+/// How many cells of the table hold entries from several cells of the world.
+/// </summary>
+/// <param name="spatialHash">The Spatial Hash to measure.</param>
+/// <returns>The counts.</returns>
+AliasingStats GetAliasing(SpatialHash* spatialHash)
+{
+    return spatialHash->GetAliasingStats();
+}
+
+/// <summary>
+/// Fills a struct with what the Spatial Hash has done and how full its cells are, see SpatialHashStats.
+/// The counters are only counted when the library is built with SPATIALHASH_STATS.
+/// </summary>
+/// <param name="stats">Gets the stats.</param>
+/// <param name="reset">1 to set the counters and timers to zero afterwards.</param>
+/// <param name="spatialHash">The Spatial Hash to get the stats of.</param>
+void GetStats(SpatialHashStats* stats, uint32_t reset, SpatialHash* spatialHash)
+{
+    spatialHash->GetStats(*stats, reset != 0);
+}
+
+/// <summary>
+/// Makes Init() pick the table size and cell size from the density of the entries and a search distance.
+/// </summary>
+/// <param name="expectedSearchDistance">The typical search distance, 0 turns it off.</param>
+/// <param name="spatialHash">The Spatial Hash to tune.</param>
+void SetAutoTune(float expectedSearchDistance, SpatialHash* spatialHash)
+{
+    spatialHash->SetAutoTune(expectedSearchDistance);
+}
+
+/// <summary>
+/// The table of the Spatial Hash is 2^GetTableSize() cells wide and high.
+/// </summary>
+/// <param name="spatialHash">The Spatial Hash to measure.</param>
+/// <returns>The power of two of the side length.</returns>
+uint32_t GetTableSize(SpatialHash* spatialHash)
+{
+    return spatialHash->SidePower();
+}
+
+/// <summary>
+/// The side length of the cells of the Spatial Hash.
+/// </summary>
+/// <param name="spatialHash">The Spatial Hash to measure.</param>
+/// <returns>The cell size.</returns>
+float GetCellSize(SpatialHash* spatialHash)
+{
+    return spatialHash->CellSize();
+}
+
+/// <summary>
+/// Loads the SpatialHash with the start number of entries via an array of entries.
 /// Also initilizes the offsets of the Spatial Hash.
 /// </summary>
 /// <param name="nrEntries">Number of entries in the globalEntries array.</param>
@@ -502,6 +4089,147 @@ CloseIdsAndNrOf GetEntries(int32_t  nrPositions, Position* position, float d, in
     return spatialHash->GetCloseEntriesBulk(nrPositions, position, d, maxEntities);
 }
 
+/// <summary>
+/// Like GetEntries(), but only entries in one of the layers of layerMask are found, see SetLayers().
+/// </summary>
+/// <param name="nrPositions">Number of positions to search.</param>
+/// <param name="position">Positions to check for close entries, An array of size nrPositions.</param>
+/// <param name="d">How far away from the position entries can be to be close.</param>
+/// <param name="maxEntities">Maximum number of entries to return per search.</param>
+/// <param name="layerMask">The layers to look in, one bit per layer.</param>
+/// <param name="spatialHash">Which Spatial Hash to look in.</param>
+/// <returns>A ordered list of entries close to input position and the number of entries per search.</returns>
+CloseIdsAndNrOf GetEntriesInLayers(int32_t nrPositions, Position* position, float d, int32_t maxEntities, uint32_t layerMask, SpatialHash* spatialHash)
+{
+    return spatialHash->GetCloseEntriesBulk(nrPositions, position, d, maxEntities, layerMask);
+}
+
+/// <summary>
+/// The same as GetEntries(), but the results are written into buffers owned by the caller. Doesn't change
+/// the Spatial Hash, so it can be called from several threads at once.
+/// </summary>
+/// <param name="nrPositions">Number of positions to search around.</param>
+/// <param name="position">An array of positions, nrPositions long.</param>
+/// <param name="d">Distance in which entries are considered close.</param>
+/// <param name="maxEntities">Max number of entries per position to return.</param>
+/// <param name="nrOfEntries">Gets where the results of every search end, nrPositions long.</param>
+/// <param name="closeEntries">Gets the results, capacity long.</param>
+/// <param name="capacity">The number of entries closeEntries has room for.</param>
+/// <param name="spatialHash">The Spatial Hash to search.</param>
+/// <returns>How many searches were done, how many entries were written and if closeEntries was too small.</returns>
+SearchResult GetEntriesInto(int32_t nrPositions, Position* position, float d, int32_t maxEntities, uint32_t* nrOfEntries, IdWithDistance* closeEntries, uint32_t capacity, SpatialHash* spatialHash)
+{
+    return spatialHash->GetCloseEntriesInto(nrPositions, position, d, maxEntities, nrOfEntries, closeEntries, capacity);
+}
+
+/// <summary>
+/// The same as GetEntries(), but every position has its own search distance and max number of entries.
+/// </summary>
+/// <param name="nrPositions">Number of positions to search around.</param>
+/// <param name="position">An array of positions, nrPositions long.</param>
+/// <param name="d">The distance of every search, nrPositions long.</param>
+/// <param name="maxEntities">Max number of entries of every search, nrPositions long.</param>
+/// <param name="spatialHash">The Spatial Hash to search.</param>
+/// <returns>The entries that are close to the positions and how many of them there are.</returns>
+CloseIdsAndNrOf GetEntriesVarying(int32_t nrPositions, Position* position, float* d, int32_t* maxEntities, SpatialHash* spatialHash)
+{
+    return spatialHash->GetCloseEntriesBulk(nrPositions, position, d, maxEntities);
+}
+
+/// <summary>
+/// Gets the k closest entries to every position, without a search distance.
+/// </summary>
+/// <param name="nrPositions">Number of positions to search around.</param>
+/// <param name="position">An array of positions, nrPositions long.</param>
+/// <param name="k">The number of entries to find per position.</param>
+/// <param name="spatialHash">The Spatial Hash to search.</param>
+/// <returns>The closest entries to the positions and how many of them there are.</returns>
+CloseIdsAndNrOf GetNearest(int32_t nrPositions, Position* position, int32_t k, SpatialHash* spatialHash)
+{
+    return spatialHash->GetNearestEntriesBulk(nrPositions, position, k);
+}
+
+/// <summary>
+/// Gets the entries inside of axis aligned boxes.
+/// </summary>
+/// <param name="nrOfBoxes">Number of boxes to search.</param>
+/// <param name="lows">The lowest corner of every box, nrOfBoxes long.</param>
+/// <param name="highs">The highest corner of every box, nrOfBoxes long.</param>
+/// <param name="maxEntities">Max number of entries per box to return, the closest to its center.</param>
+/// <param name="spatialHash">The Spatial Hash to search.</param>
+/// <returns>The entries inside of the boxes and how many of them there are.</returns>
+CloseIdsAndNrOf GetEntriesInBoxes(int32_t nrOfBoxes, Position* lows, Position* highs, int32_t maxEntities, SpatialHash* spatialHash)
+{
+    return spatialHash->GetEntriesInBoxesBulk(nrOfBoxes, lows, highs, maxEntities);
+}
+
+/// <summary>
+/// Gets the entries close to line segments, in the order the segments pass them.
+/// </summary>
+/// <param name="nrOfSegments">Number of segments to search along.</param>
+/// <param name="from">Where every segment starts, nrOfSegments long.</param>
+/// <param name="to">Where every segment ends, nrOfSegments long.</param>
+/// <param name="d">How close to a segment entries have to be.</param>
+/// <param name="maxEntities">Max number of entries per segment to return, the first along it.</param>
+/// <param name="spatialHash">The Spatial Hash to search.</param>
+/// <returns>The entries close to the segments and how many of them there are.</returns>
+CloseIdsAndNrOf GetEntriesAlongSegments(int32_t nrOfSegments, Position* from, Position* to, float d, int32_t maxEntities, SpatialHash* spatialHash)
+{
+    return spatialHash->GetEntriesAlongSegmentsBulk(nrOfSegments, from, to, d, maxEntities);
+}
+
+/// <summary>
+/// Gets the entries circles touch when moving in straight lines, in the order they touch them.
+/// </summary>
+/// <param name="nrOfCircles">Number of moving circles.</param>
+/// <param name="from">Where every circle starts, nrOfCircles long.</param>
+/// <param name="to">Where every circle ends up, nrOfCircles long.</param>
+/// <param name="radius">The radius of the circles.</param>
+/// <param name="maxEntities">Max number of entries per circle to return, the first touched.</param>
+/// <param name="spatialHash">The Spatial Hash to search.</param>
+/// <returns>The entries the circles touch and how many of them there are.</returns>
+CloseIdsAndNrOf GetEntriesSwept(int32_t nrOfCircles, Position* from, Position* to, float radius, int32_t maxEntities, SpatialHash* spatialHash)
+{
+    return spatialHash->GetEntriesSweptBulk(nrOfCircles, from, to, radius, maxEntities);
+}
+
+/// <summary>
+/// The same as GetEntries(), but positions in the same cell are searched together. Faster when
+/// many of the positions are close to each other.
+/// </summary>
+/// <param name="nrPositions">Number of positions to search around.</param>
+/// <param name="position">An array of positions, nrPositions long.</param>
+/// <param name="d">Distance in which entries are considered close.</param>
+/// <param name="maxEntities">Max number of entries per position to return.</param>
+/// <param name="spatialHash">The Spatial Hash to search.</param>
+/// <returns>The entries that are close to the positions and how many of them there are.</returns>
+CloseIdsAndNrOf GetEntriesGrouped(int32_t nrPositions, Position* position, float d, int32_t maxEntities, SpatialHash* spatialHash)
+{
+    return spatialHash->GetCloseEntriesBulkGrouped(nrPositions, position, d, maxEntities);
+}
+
+/// <summary>
+/// Finds every pair of entries that are within a distance of each other, each pair once.
+/// </summary>
+/// <param name="d">The distance the entries of a pair have to be closer than.</param>
+/// <param name="spatialHash">The Spatial Hash to search.</param>
+/// <returns>The pairs and how many they are.</returns>
+ClosePairsAndNrOf GetPairs(float d, SpatialHash* spatialHash)
+{
+    return spatialHash->GetClosePairs(d);
+}
+
+/// <summary>
+/// Finds the neighbours within a distance of every entry.
+/// </summary>
+/// <param name="d">The distance the neighbours have to be closer than.</param>
+/// <param name="spatialHash">The Spatial Hash to search.</param>
+/// <returns>For every id where its neighbours end, and all the neighbours.</returns>
+CloseIdsAndNrOf GetNeighbours(float d, SpatialHash* spatialHash)
+{
+    return spatialHash->GetNeighboursOfAll(d);
+}
+
 /// <summary>
 /// Checks if entries of input spatial hash has changed and updates itself accordingly.
 /// </summary>
@@ -511,7 +4239,256 @@ void Update(SpatialHash* spatialHash)
     spatialHash->UpdateTable();
 }
 
+/// <summary>
+/// Removes entries from the Spatial Hash, their ids will be used again by inserted entries.
+/// </summary>
+/// <param name="nrOfEntriesToRemove">Number of entries to remove.</param>
+/// <param name="entryIndices">Ids of the entries to remove, an array of size nrOfEntriesToRemove.</param>
+/// <param name="spatialHash">The Spatial Hash to remove from.</param>
 void Remove(uint32_t nrOfEntriesToRemove, uint32_t* entryIndices, SpatialHash* spatialHash)
 {
     spatialHash->RemoveEntryFromTableBulk(nrOfEntriesToRemove, entryIndices);
 }
+
+/// <summary>
+/// Gives some entries new positions, without going through all of them like Update() does.
+/// </summary>
+/// <param name="nrOfEntriesToUpdate">Number of entries that have moved.</param>
+/// <param name="ids">Ids of the entries that have moved, an array of size nrOfEntriesToUpdate.</param>
+/// <param name="positions">The new positions, an array of size nrOfEntriesToUpdate.</param>
+/// <param name="spatialHash">The Spatial Hash to update.</param>
+void UpdateEntries(uint32_t nrOfEntriesToUpdate, uint32_t* ids, Position* positions, SpatialHash* spatialHash)
+{
+    spatialHash->UpdateEntriesBulk(nrOfEntriesToUpdate, ids, positions);
+}
+
+/// <summary>
+/// Sets how far outside of their cells entries can be before they are moved to other cells.
+/// </summary>
+/// <param name="margin">The distance, less than half a cell.</param>
+/// <param name="spatialHash">The Spatial Hash to set it for.</param>
+void SetHysteresis(float margin, SpatialHash* spatialHash)
+{
+    spatialHash->SetHysteresis(margin);
+}
+
+/// <summary>
+/// Inserts new entries into the Spatial Hash without rebuilding it.
+/// </summary>
+/// <param name="nrOfEntriesToInsert">Number of entries to insert.</param>
+/// <param name="positions">Positions of the new entries, an array of size nrOfEntriesToInsert.</param>
+/// <param name="ids">Gets the ids of the new entries, an array of size nrOfEntriesToInsert.</param>
+/// <param name="spatialHash">The Spatial Hash to insert into.</param>
+void Insert(uint32_t nrOfEntriesToInsert, Position* positions, uint32_t* ids, SpatialHash* spatialHash)
+{
+    spatialHash->InsertEntriesBulk(nrOfEntriesToInsert, positions, ids);
+}
+
+/// <summary>
+/// Gives the Spatial Hash a new array of entries to read positions from when it's updated.
+/// </summary>
+/// <param name="nrEntries">Number of entries in the globalEntries array.</param>
+/// <param name="globalEntries">An array of Entry structs, the entry with id i at place i.</param>
+/// <param name="spatialHash">The Spatial Hash to give the array to.</param>
+void Attach(uint32_t nrEntries, Entry* globalEntries, SpatialHash* spatialHash)
+{
+    spatialHash->AttachEntries(globalEntries, nrEntries);
+}
+
+/// <summary>
+/// Makes the Spatial Hash ready for searches up to a certain distance, so that the first
+/// search that far doesn't have to do it.
+/// </summary>
+/// <param name="d">The largest distance that is going to be searched.</param>
+/// <param name="spatialHash">The Spatial Hash that is going to be searched.</param>
+void SetSearchDistance(float d, SpatialHash* spatialHash)
+{
+    spatialHash->SetMaxSearchDistance(d);
+}
+
+/// <summary>
+/// Turns double buffering on or off. When it's on, GetEntriesInto() can be called from other threads
+/// while Update(), UpdateEntries(), Insert() or Remove() runs, and sees the entries as they were before it.
+/// </summary>
+/// <param name="enabled">1 to turn it on, 0 to turn it off.</param>
+/// <param name="spatialHash">The Spatial Hash.</param>
+void SetDoubleBuffered(uint32_t enabled, SpatialHash* spatialHash)
+{
+    spatialHash->SetDoubleBuffered(enabled != 0);
+}
+
+/// <summary>
+/// Turns compact cells on or off. They take less memory and searches read less of it, but can't be double buffered.
+/// </summary>
+/// <param name="enabled">1 to turn it on, 0 to turn it off.</param>
+/// <param name="spatialHash">The Spatial Hash.</param>
+void SetCompact(uint32_t enabled, SpatialHash* spatialHash)
+{
+    spatialHash->SetCompact(enabled != 0);
+}
+
+/// <summary>
+/// Puts entries in layers, one bit per layer, for GetEntriesInLayers(). Entries are in every layer until this is called.
+/// </summary>
+/// <param name="nrOfEntries">Number of entries to give layer masks.</param>
+/// <param name="ids">Ids of the entries, an array of size nrOfEntries.</param>
+/// <param name="layers">The layer mask of every entry, an array of size nrOfEntries.</param>
+/// <param name="spatialHash">The Spatial Hash.</param>
+void SetLayers(uint32_t nrOfEntries, uint32_t* ids, uint32_t* layers, SpatialHash* spatialHash)
+{
+    spatialHash->SetLayers(nrOfEntries, ids, layers);
+}
+
+/// <summary>
+/// Starts an Update() on the job queue of the Spatial Hash and returns without waiting for it.
+/// The jobs of a Spatial Hash are run in the order they are submitted. Until a job is done the Spatial Hash
+/// may only be updated through the other job functions. If it's double buffered, searches no further than
+/// SetSearchDistance() may run meanwhile.
+/// </summary>
+/// <param name="spatialHash">The Spatial Hash to update.</param>
+/// <returns>The ticket of the job, for IsJobDone() and WaitForJob().</returns>
+uint64_t SubmitUpdate(SpatialHash* spatialHash)
+{
+    return spatialHash->SubmitUpdateTable();
+}
+
+/// <summary>
+/// Starts an UpdateEntries() on the job queue, see SubmitUpdate(). The arrays must be kept until the job is done.
+/// </summary>
+/// <param name="nrOfEntriesToUpdate">Number of entries that have moved.</param>
+/// <param name="ids">Ids of the entries.</param>
+/// <param name="positions">The new positions of the entries.</param>
+/// <param name="spatialHash">The Spatial Hash to update.</param>
+/// <returns>The ticket of the job.</returns>
+uint64_t SubmitUpdateEntries(uint32_t nrOfEntriesToUpdate, uint32_t* ids, Position* positions, SpatialHash* spatialHash)
+{
+    return spatialHash->SubmitUpdateEntries(nrOfEntriesToUpdate, ids, positions);
+}
+
+/// <summary>
+/// Starts a GetEntriesInto() on the job queue, see SubmitUpdate(). It's run after the jobs submitted before it,
+/// so it sees their updates. Only reads the Spatial Hash, so searches no further than SetSearchDistance() may run
+/// meanwhile. The arrays must be kept until the job is done, when result is filled in.
+/// </summary>
+/// <param name="nrOfPositions">Number of positions to search around.</param>
+/// <param name="position">The positions.</param>
+/// <param name="d">Distance in which entries are considered close.</param>
+/// <param name="maxEntities">Max number of entries per position.</param>
+/// <param name="nrOfEntries">Gets where the entries of every position end in closeEntries.</param>
+/// <param name="closeEntries">Gets the entries.</param>
+/// <param name="capacity">The number of IdWithDistance:s closeEntries has room for.</param>
+/// <param name="result">Gets how many searches were done, how many entries were written and if closeEntries was too small.</param>
+/// <param name="spatialHash">The Spatial Hash to search.</param>
+/// <returns>The ticket of the job.</returns>
+uint64_t SubmitEntriesInto(int32_t nrOfPositions, Position* position, float d, int32_t maxEntities, uint32_t* nrOfEntries, IdWithDistance* closeEntries, uint32_t capacity, SearchResult* result, SpatialHash* spatialHash)
+{
+    return spatialHash->SubmitCloseEntriesInto(nrOfPositions, position, d, maxEntities, nrOfEntries, closeEntries, capacity, result);
+}
+
+/// <summary>
+/// Tells if a job is done, without waiting.
+/// </summary>
+/// <param name="ticket">From one of the Submit functions.</param>
+/// <param name="spatialHash">The Spatial Hash the job was submitted to.</param>
+/// <returns>1 if the job, and every job submitted before it, is done, otherwise 0.</returns>
+uint32_t IsJobDone(uint64_t ticket, SpatialHash* spatialHash)
+{
+    return spatialHash->IsJobDone(ticket) ? 1 : 0;
+}
+
+/// <summary>
+/// Waits until a job, and every job submitted before it, is done.
+/// </summary>
+/// <param name="ticket">From one of the Submit functions.</param>
+/// <param name="spatialHash">The Spatial Hash the job was submitted to.</param>
+void WaitForJob(uint64_t ticket, SpatialHash* spatialHash)
+{
+    spatialHash->WaitForJob(ticket);
+}
+
+/// <summary>
+/// Defines the interop of another instantiation, see SPATIALHASH_DECLARE_INTEROPS. Every function does
+/// what the function without the suffix does for SpatialHash.
+/// </summary>
+#define SPATIALHASH_DEFINE_INTEROPS(suffix, dim, scalar) \
+    void* Start##suffix(uint32_t tableSize, float cellSize) { return new BasicSpatialHash<dim, scalar>(tableSize, cellSize); } \
+    void SetAutoTune##suffix(float expectedSearchDistance, BasicSpatialHash<dim, scalar>* spatialHash) { spatialHash->SetAutoTune(expectedSearchDistance); } \
+    void SetHashMode##suffix(uint32_t mode, BasicPosition<dim, scalar>* origin, BasicSpatialHash<dim, scalar>* spatialHash) { spatialHash->SetHashMode(static_cast<HashMode>(mode), *origin); } \
+    AliasingStats GetAliasing##suffix(BasicSpatialHash<dim, scalar>* spatialHash) { return spatialHash->GetAliasingStats(); } \
+    void GetStats##suffix(SpatialHashStats* stats, uint32_t reset, BasicSpatialHash<dim, scalar>* spatialHash) { spatialHash->GetStats(*stats, reset != 0); } \
+    uint32_t GetTableSize##suffix(BasicSpatialHash<dim, scalar>* spatialHash) { return spatialHash->SidePower(); } \
+    float GetCellSize##suffix(BasicSpatialHash<dim, scalar>* spatialHash) { return spatialHash->CellSize(); } \
+    void Init##suffix(uint32_t nrEntries, BasicEntry<dim, scalar>* globalEntries, BasicSpatialHash<dim, scalar>* spatialHash) { spatialHash->Initilize(globalEntries, nrEntries); } \
+    uint32_t Stop##suffix(BasicSpatialHash<dim, scalar>* spatialHash) { delete spatialHash; return 0; } \
+    CloseIdsAndNrOf GetEntries##suffix(int32_t nrPositions, BasicPosition<dim, scalar>* position, float d, int32_t maxEntities, BasicSpatialHash<dim, scalar>* spatialHash) \
+    { \
+        return spatialHash->GetCloseEntriesBulk(nrPositions, position, d, maxEntities); \
+    } \
+    CloseIdsAndNrOf GetEntriesInLayers##suffix(int32_t nrPositions, BasicPosition<dim, scalar>* position, float d, int32_t maxEntities, uint32_t layerMask, BasicSpatialHash<dim, scalar>* spatialHash) \
+    { \
+        return spatialHash->GetCloseEntriesBulk(nrPositions, position, d, maxEntities, layerMask); \
+    } \
+    CloseIdsAndNrOf GetEntriesVarying##suffix(int32_t nrPositions, BasicPosition<dim, scalar>* position, float* d, int32_t* maxEntities, BasicSpatialHash<dim, scalar>* spatialHash) \
+    { \
+        return spatialHash->GetCloseEntriesBulk(nrPositions, position, d, maxEntities); \
+    } \
+    CloseIdsAndNrOf GetNearest##suffix(int32_t nrPositions, BasicPosition<dim, scalar>* position, int32_t k, BasicSpatialHash<dim, scalar>* spatialHash) \
+    { \
+        return spatialHash->GetNearestEntriesBulk(nrPositions, position, k); \
+    } \
+    CloseIdsAndNrOf GetEntriesInBoxes##suffix(int32_t nrOfBoxes, BasicPosition<dim, scalar>* lows, BasicPosition<dim, scalar>* highs, int32_t maxEntities, BasicSpatialHash<dim, scalar>* spatialHash) \
+    { \
+        return spatialHash->GetEntriesInBoxesBulk(nrOfBoxes, lows, highs, maxEntities); \
+    } \
+    CloseIdsAndNrOf GetEntriesAlongSegments##suffix(int32_t nrOfSegments, BasicPosition<dim, scalar>* from, BasicPosition<dim, scalar>* to, float d, int32_t maxEntities, BasicSpatialHash<dim, scalar>* spatialHash) \
+    { \
+        return spatialHash->GetEntriesAlongSegmentsBulk(nrOfSegments, from, to, d, maxEntities); \
+    } \
+    CloseIdsAndNrOf GetEntriesSwept##suffix(int32_t nrOfCircles, BasicPosition<dim, scalar>* from, BasicPosition<dim, scalar>* to, float radius, int32_t maxEntities, BasicSpatialHash<dim, scalar>* spatialHash) \
+    { \
+        return spatialHash->GetEntriesSweptBulk(nrOfCircles, from, to, radius, maxEntities); \
+    } \
+    SearchResult GetEntriesInto##suffix(int32_t nrPositions, BasicPosition<dim, scalar>* position, float d, int32_t maxEntities, uint32_t* nrOfEntries, IdWithDistance* closeEntries, uint32_t capacity, BasicSpatialHash<dim, scalar>* spatialHash) \
+    { \
+        return spatialHash->GetCloseEntriesInto(nrPositions, position, d, maxEntities, nrOfEntries, closeEntries, capacity); \
+    } \
+    CloseIdsAndNrOf GetEntriesGrouped##suffix(int32_t nrPositions, BasicPosition<dim, scalar>* position, float d, int32_t maxEntities, BasicSpatialHash<dim, scalar>* spatialHash) \
+    { \
+        return spatialHash->GetCloseEntriesBulkGrouped(nrPositions, position, d, maxEntities); \
+    } \
+    ClosePairsAndNrOf GetPairs##suffix(float d, BasicSpatialHash<dim, scalar>* spatialHash) { return spatialHash->GetClosePairs(d); } \
+    CloseIdsAndNrOf GetNeighbours##suffix(float d, BasicSpatialHash<dim, scalar>* spatialHash) { return spatialHash->GetNeighboursOfAll(d); } \
+    void Update##suffix(BasicSpatialHash<dim, scalar>* spatialHash) { spatialHash->UpdateTable(); } \
+    void UpdateEntries##suffix(uint32_t nrOfEntriesToUpdate, uint32_t* ids, BasicPosition<dim, scalar>* positions, BasicSpatialHash<dim, scalar>* spatialHash) \
+    { \
+        spatialHash->UpdateEntriesBulk(nrOfEntriesToUpdate, ids, positions); \
+    } \
+    void SetHysteresis##suffix(float margin, BasicSpatialHash<dim, scalar>* spatialHash) { spatialHash->SetHysteresis(margin); } \
+    void Remove##suffix(uint32_t nrOfEntriesToRemove, uint32_t* entryIndices, BasicSpatialHash<dim, scalar>* spatialHash) \
+    { \
+        spatialHash->RemoveEntryFromTableBulk(nrOfEntriesToRemove, entryIndices); \
+    } \
+    void Insert##suffix(uint32_t nrOfEntriesToInsert, BasicPosition<dim, scalar>* positions, uint32_t* ids, BasicSpatialHash<dim, scalar>* spatialHash) \
+    { \
+        spatialHash->InsertEntriesBulk(nrOfEntriesToInsert, positions, ids); \
+    } \
+    void Attach##suffix(uint32_t nrEntries, BasicEntry<dim, scalar>* globalEntries, BasicSpatialHash<dim, scalar>* spatialHash) { spatialHash->AttachEntries(globalEntries, nrEntries); } \
+    void SetSearchDistance##suffix(float d, BasicSpatialHash<dim, scalar>* spatialHash) { spatialHash->SetMaxSearchDistance(d); } \
+    void SetDoubleBuffered##suffix(uint32_t enabled, BasicSpatialHash<dim, scalar>* spatialHash) { spatialHash->SetDoubleBuffered(enabled != 0); } \
+    void SetCompact##suffix(uint32_t enabled, BasicSpatialHash<dim, scalar>* spatialHash) { spatialHash->SetCompact(enabled != 0); } \
+    void SetLayers##suffix(uint32_t nrOfEntries, uint32_t* ids, uint32_t* layers, BasicSpatialHash<dim, scalar>* spatialHash) { spatialHash->SetLayers(nrOfEntries, ids, layers); } \
+    uint64_t SubmitUpdate##suffix(BasicSpatialHash<dim, scalar>* spatialHash) { return spatialHash->SubmitUpdateTable(); } \
+    uint64_t SubmitUpdateEntries##suffix(uint32_t nrOfEntriesToUpdate, uint32_t* ids, BasicPosition<dim, scalar>* positions, BasicSpatialHash<dim, scalar>* spatialHash) \
+    { \
+        return spatialHash->SubmitUpdateEntries(nrOfEntriesToUpdate, ids, positions); \
+    } \
+    uint64_t SubmitEntriesInto##suffix(int32_t nrPositions, BasicPosition<dim, scalar>* position, float d, int32_t maxEntities, uint32_t* nrOfEntries, IdWithDistance* closeEntries, uint32_t capacity, SearchResult* result, BasicSpatialHash<dim, scalar>* spatialHash) \
+    { \
+        return spatialHash->SubmitCloseEntriesInto(nrPositions, position, d, maxEntities, nrOfEntries, closeEntries, capacity, result); \
+    } \
+    uint32_t IsJobDone##suffix(uint64_t ticket, BasicSpatialHash<dim, scalar>* spatialHash) { return spatialHash->IsJobDone(ticket) ? 1 : 0; } \
+    void WaitForJob##suffix(uint64_t ticket, BasicSpatialHash<dim, scalar>* spatialHash) { spatialHash->WaitForJob(ticket); }
+
+SPATIALHASH_DEFINE_INTEROPS(3f, 3, float)
+SPATIALHASH_DEFINE_INTEROPS(2d, 2, double)
+SPATIALHASH_DEFINE_INTEROPS(3d, 3, double)
@@ -7,49 +7,109 @@
 #include <memory>
 #include <math.h>
 #include <cstdint>
-#include <fstream>
+#include <algorithm>
+#include <unordered_map>
+#include <limits>
+#include <array>
+
+#include "WorkerPool.h"
+#include "JobQueue.h"
+#include "DistanceKernel.h"
+#include "SpatialStats.h"
+
+// Marks the functions that are called from outside of the library. SPATIALHASH_EXPORTS is defined when the
+// library itself is built, programs using the library get the functions imported instead.
+#if defined(_WIN32)
+#if defined(SPATIALHASH_EXPORTS)
+#define SPATIALHASH_API extern "C" __declspec(dllexport)
+#else
+#define SPATIALHASH_API extern "C" __declspec(dllimport)
+#endif
+#else
+#define SPATIALHASH_API extern "C" __attribute__((visibility("default")))
+#endif
 
 /// <summary>
-/// Everything stored in the Spatial Hash have a 2d-coordinate, which is recorded as Position.
+/// Everything stored in the Spatial Hash have a coordinate in Dim dimensions, which is recorded as a position.
+/// There is one for 2d and one for 3d space, with coordinates of type Scalar.
 /// </summary>
-struct Position
+template<uint32_t Dim, typename Scalar>
+struct BasicPosition;
+
+template<typename Scalar>
+struct BasicPosition<2, Scalar>
 {
-    float x;
-    float y;
+    Scalar x;
+    Scalar y;
+
+    BasicPosition() : x(0), y(0) {}
+    BasicPosition(Scalar inX, Scalar inY) : x(inX), y(inY) {}
+    ~BasicPosition() {}
+
+    // The coordinate along an axis, 0 for x and 1 for y.
+    Scalar operator[](uint32_t axis) const { return axis == 0 ? x : y; }
+};
+
+template<typename Scalar>
+struct BasicPosition<3, Scalar>
+{
+    Scalar x;
+    Scalar y;
+    Scalar z;
+
+    BasicPosition() : x(0), y(0), z(0) {}
+    BasicPosition(Scalar inX, Scalar inY, Scalar inZ) : x(inX), y(inY), z(inZ) {}
+    ~BasicPosition() {}
 
-    Position() : x(0.0f), y(0.0f) {}
-    Position(float inX, float inY) : x(inX), y(inY) {}
-    ~Position() {}
+    // The coordinate along an axis, 0 for x, 1 for y and 2 for z.
+    Scalar operator[](uint32_t axis) const { return axis == 0 ? x : (axis == 1 ? y : z); }
 };
 
+using Position = BasicPosition<2, float>;
+using Position3f = BasicPosition<3, float>;
+using Position2d = BasicPosition<2, double>;
+using Position3d = BasicPosition<3, double>;
+
 /// <summary>
-/// Every thing in the Spatial Hash, every Entry, has, besides a place in 2d space, also a id.
+/// Every thing in the Spatial Hash, every Entry, has, besides a place in space, also a id.
 /// The id of an Entry is it's place in the allEntries array.
 /// </summary>
-struct Entry
+template<uint32_t Dim, typename Scalar>
+struct BasicEntry
 {
     uint32_t id;
-    Position position;
+    BasicPosition<Dim, Scalar> position;
 
-    Entry() : id(0), position() {}
-    Entry(uint32_t inId, Position inPosition) : position(inPosition), id(inId) {}
-    ~Entry() {}
+    BasicEntry() : id(0), position() {}
+    BasicEntry(uint32_t inId, BasicPosition<Dim, Scalar> inPosition) : position(inPosition), id(inId) {}
+    ~BasicEntry() {}
 };
 
+using Entry = BasicEntry<2, float>;
+using Entry3f = BasicEntry<3, float>;
+using Entry2d = BasicEntry<2, double>;
+using Entry3d = BasicEntry<3, double>;
+
+// The layer mask of entries that haven't been given one, and of searches that look in every layer, see SetLayers().
+constexpr uint32_t allLayers = 0xFFFFFFFF;
+
 /// <summary>
 /// Each Entry needs to know it's place in the cell of the Spatial Hash and what cell it's in, 
 /// for efficient removal.
 /// So when a Entry is inserted in the Spatial Hash its number in the cell and hash value are saved.
+/// Its layer mask is kept here too, so the cells can be sorted again without losing it.
 /// </summary>
-struct Entered
+template<uint32_t Dim, typename Scalar>
+struct BasicEntered
 {
-    Entry entry;
+    BasicEntry<Dim, Scalar> entry;
     uint32_t nrInCell;
     uint32_t hashValue;
+    uint32_t layers;
 
-    Entered(Entry inEntry, uint32_t inNrInCell, uint32_t inHashValue) :entry(inEntry), nrInCell(inNrInCell), hashValue(inHashValue) {}
-    Entered() : entry(), nrInCell(0), hashValue(0) {}
-    ~Entered() {}
+    BasicEntered(BasicEntry<Dim, Scalar> inEntry, uint32_t inNrInCell, uint32_t inHashValue) :entry(inEntry), nrInCell(inNrInCell), hashValue(inHashValue), layers(allLayers) {}
+    BasicEntered() : entry(), nrInCell(0), hashValue(0), layers(allLayers) {}
+    ~BasicEntered() {}
 };
 
 /// <summary>
@@ -98,41 +158,309 @@ struct CloseIdsAndNrOf
     IdWithDistance* allCloseEntries;
 };
 
+/// <summary>
+/// What GetCloseEntriesInto() managed to do. The searches [0, nrOfSearches) were done and nrOfEntries
+/// entries were written. overflow is 1 if the rest of the searches didn't fit in the buffer, otherwise 0.
+/// </summary>
+struct SearchResult
+{
+    uint32_t nrOfSearches;
+    uint32_t nrOfEntries;
+    uint32_t overflow;
+};
+
+/// <summary>
+/// Two entries that are within a distance of each other, found by GetClosePairs().
+/// </summary>
+struct IdPair
+{
+    uint32_t first;
+    uint32_t second;
+    float distance;
+
+    IdPair(uint32_t inFirst, uint32_t inSecond, float inDistance) : first(inFirst), second(inSecond), distance(inDistance) {}
+    IdPair() : first(0), second(0), distance(0.0f) {}
+
+    ~IdPair() {}
+};
+
+/// <summary>
+/// GetClosePairs() returns this, every close pair once and how many there are.
+/// </summary>
+struct ClosePairsAndNrOf
+{
+    uint32_t nrOfPairs;
+    IdPair* pairs;
+};
+
+/// <summary>
+/// The coordinates of a cell, of the world or of the table, one per axis. Also used for offsets between cells.
+/// </summary>
+template<uint32_t Dim>
+using CellKey = std::array<int32_t, Dim>;
+
+/// <summary>
+/// An offset from a cell to another cell, both in the table, used by GetClosePairs().
+/// If the offset leads to the same cell from both ends (selfInverse) the pair of cells is only
+/// searched from the cell with the lower number.
+/// </summary>
+template<uint32_t Dim>
+struct PairOffset
+{
+    CellKey<Dim> offset;
+    bool selfInverse;
+};
+
+/// <summary>
+/// How the cells of the world are put into the table.
+/// Wrapped: cells are wrapped around the table, so cells a table length apart share a cell of the table.
+/// Hashed: the coordinates of a cell are hashed, cells only share a bucket when their hashes collide.
+/// Bounded: the world is the table, positions outside of it are put in the closest cell at its edge.
+/// </summary>
+enum class HashMode : uint32_t
+{
+    Wrapped = 0,
+    Hashed = 1,
+    Bounded = 2
+};
+
+/// <summary>
+/// How many of the occupied cells of the table hold entries from more than one cell of the world.
+/// worldCells is the number of cells of the world the entries are in.
+/// </summary>
+struct AliasingStats
+{
+    uint32_t occupiedCells;
+    uint32_t aliasedCells;
+    uint32_t entriesInAliasedCells;
+    uint32_t worldCells;
+};
+
+// Number of bins of the occupancy histogram of SpatialHashStats.
+constexpr uint32_t occupancyBins = 16;
+
+/// <summary>
+/// What the Spatial Hash has done since the stats were last reset, from GetStats().
+/// The counters and timers are only counted when built with SPATIALHASH_STATS, then enabled is 1.
+/// stepsWalked is the number of steps of offsets, rings of cells at the same distance, that searches went through.
+/// cellsSkipped are cells in those steps that couldn't hold anything close enough, or in HashMode::Hashed held another cell.
+/// aliasingRejections are tested candidates from another cell of the world than the one searched.
+/// migrations are entries that changed cell in updates. The times are in milliseconds.
+/// occupancy[0] is the number of empty cells and occupancy[i] the cells with 2^(i - 1) up to 2^i entries,
+/// the last bin has all the fuller cells. The occupancy is counted when GetStats() is called, with or without SPATIALHASH_STATS.
+/// </summary>
+struct SpatialHashStats
+{
+    uint32_t enabled;
+    uint32_t maxOccupancy;
+    uint64_t searches;
+    uint64_t stepsWalked;
+    uint64_t cellsVisited;
+    uint64_t cellsSkipped;
+    uint64_t candidatesTested;
+    uint64_t hits;
+    uint64_t rejectedByDistance;
+    uint64_t aliasingRejections;
+    uint64_t updates;
+    uint64_t migrations;
+    uint64_t rebuilds;
+    double updateMs;
+    double searchMs;
+    double pairsMs;
+    double rebuildMs;
+    uint32_t occupancy[occupancyBins];
+};
+
+
+/// <summary>
+/// Keeps the maxEntities closest of the entries it is offered, appended to the end of found.
+/// While searching the distances are squared distances. If few entries are kept they are kept sorted
+/// with insertion sort, if many they are kept in a max-heap with the furthest entry first, so that
+/// an entry that is closer than the furthest one can replace it without sorting everything.
+/// </summary>
+class ClosestSelection
+{
+public:
+    ClosestSelection(std::vector<IdWithDistance>& inFound, int32_t maxEntities, float d);
+
+    // The squared distance an entry has to be closer than to be kept.
+    float Limit() const { return limit; }
+
+    // True when maxEntities entries are kept.
+    bool IsFull() const { return found.size() - start == maxEntities; }
+
+    // Keeps the entry if it's among the maxEntities closest so far.
+    void Offer(uint32_t id, float squaredDistance);
+
+    // Sorts the kept entries by distance and turns the squared distances into distances.
+    void Finish();
+
+    // The layers an entry has to be in, one of them is enough, to be offered at all.
+    uint32_t layerMask = allLayers;
+
+#if defined(SPATIALHASH_STATS)
+    // What the search has done so far.
+    QueryCounters counters;
+#endif
+
+private:
+    std::vector<IdWithDistance>& found;
+    size_t start;
+    size_t maxEntities;
+    bool useHeap;
+    float limit;
+};
+
+/// <summary>
+/// The results of a number of GetCloseEntries() searches. nrOfEntries holds, for every search, the
+/// index in closeEntries one past its last entry. Every thread doing searches has one of these.
+/// </summary>
+template<uint32_t Dim, typename Scalar>
+struct QueryBuffer
+{
+    std::vector<IdWithDistance> closeEntries;
+    std::vector<uint32_t> nrOfEntries;
+
+    // The results of each search of a group, and what is needed while searching, used by grouped bulk searches.
+    std::vector<std::vector<IdWithDistance>> groupFound;
+    std::vector<ClosestSelection> selections;
+    std::vector<BasicPosition<Dim, Scalar>> groupPositions;
+    std::vector<std::array<float, Dim>> fractions;
+    std::vector<std::array<Scalar, Dim>> queries;
+};
+
+/// <summary>
+/// A step of localized offsets, count offsets starting at start in the offset arena.
+/// </summary>
+struct OffsetStep
+{
+    uint32_t start;
+    uint32_t count;
+};
+
 /// <summary>
 /// A Spatial Hash consists of these Cells
-/// In localEntries all Entry:s that are inside of the cell in the sense of the hash-algorithm are stored.
-/// The offsets contains pointers to Cells that are close to this one, precalculated for faster lookup. 
+/// nearEdge is true for the Cells close enough to the edges of the table for offsets to wrap around it,
+/// or to leave a bounded table. All other Cells share the same offsets, precalculated for faster lookup,
+/// the offsets of Cells near the edges are worked out from the unlocalized offsets while searching.
+/// The entries of the cell are not stored here but in CellStorage.
 /// </summary>
 struct Cell
 {
-    std::vector<Entry>* localEntries;
-    std::vector<std::vector<int32_t>*>* offsets;
+    bool nearEdge;
+};
+
+/// <summary>
+/// All the entries of the Spatial Hash are stored in contiguous arrays sorted by cell.
+/// The entries of cell i are at cellStart[i] up to, but not including, cellStart[i] + cellCount[i].
+/// Every cell has some spare room after its entries, up to cellStart[i + 1], so that entries can move
+/// into it without everything having to be sorted again. cellStart has one more element than there are cells.
+/// The ids and the coordinates along every axis are kept in separate arrays (structure of arrays) so that
+/// the distance tests can load several x:s or y:s at a time.
+/// In HashMode::Hashed, and in compact cells, tags is the cell of the world that the entries of a cell are from,
+/// and mixed is set if they are from more than one. numberOfIds is the number of ids, in use or free,
+/// when the cells were published, see BasicSpatialHash::SetDoubleBuffered().
+/// If compact, quantized is used instead of coordinates, see BasicSpatialHash::SetCompact().
+/// If layered, layers has the layer mask of every entry, otherwise it's empty, see BasicSpatialHash::SetLayers().
+/// </summary>
+template<uint32_t Dim, typename Scalar>
+struct CellStorage
+{
+    uint32_t numberOfIds = 0;
+    bool compact = false;
+    bool layered = false;
+    std::vector<uint32_t> cellStart;
+    std::vector<uint32_t> cellCount;
+    std::vector<CellKey<Dim>> tags;
+    std::vector<uint8_t> mixed;
+    std::vector<uint32_t> ids;
+    std::vector<Scalar> coordinates[Dim];
+    std::vector<uint16_t> quantized[Dim];
+    std::vector<uint32_t> layers;
+};
+
+/// <summary>
+/// An entry that have moved from one cell to another since the last update.
+/// </summary>
+struct Mover
+{
+    uint32_t id;
+    uint32_t fromCell;
+    uint32_t toCell;
 };
 
 /// <summary>
 /// The Spatial Hash stores objects from an float sized space in a relatively small hash table
 /// that preserves the locality of objects. In the current implementation that is with a modulo function.
 /// This function is realized with a bitwise AND operation because of speed concerns and requires that
-/// the hash table is of size 2^n for both dimensions.
+/// the hash table is of size 2^n along every dimension.
+/// The space has Dim dimensions, 2 or 3, and the coordinates are of type Scalar, float or double.
+/// Distances, and the cell size, are floats whatever Scalar is, double only makes the positions more precise.
 /// </summary>
-class SpatialHash
+template<uint32_t Dim, typename Scalar>
+class BasicSpatialHash
 {
+    static_assert(Dim == 2 || Dim == 3, "The Spatial Hash is either 2d or 3d.");
+    static_assert(std::is_floating_point<Scalar>::value, "The coordinates are floats or doubles.");
+
 public:
+    using PositionType = BasicPosition<Dim, Scalar>;
+    using EntryType = BasicEntry<Dim, Scalar>;
+
     /// <summary>
     /// After the class have been constructed this is called and will go through all the Entered's in
     /// *allEntries and insert them into the hash table. It will also intilize the offsets.
     /// </summary>
     /// <param name="allEntries">Everything that is in the hash map should be in this array</param>
     /// <param name="numberOfEntries>The number of Entry:s in allEntries.</param>
-    void Initilize(Entry* inAllEntries, uint32_t numberOfEntries);
+    void Initilize(EntryType* inAllEntries, uint32_t numberOfEntries);
 
     /// <summary>
-    /// Checks all the Entered's in *allEntries to see if they have moved to a new cell. If they have
-    /// moved, they are reinserted and the old one is removed.
+    /// Reads the current positions of all the entries in *allEntries and rehashes them, in parallel.
+    /// The entries that have moved to a new cell are then moved, or if many have moved
+    /// all the entries are sorted into their cells again.
     /// </summary>
     void UpdateTable();
 
-    void RemoveEntryFromTableBulk(uint32_t nrOfEntriesToRemove, uint32_t* entryIndices); // Not implemented yet.
+    /// <summary>
+    /// Gives a number of entries new positions. Only these entries are looked at, so it's faster than
+    /// UpdateTable() when few entries have moved. Ids inside of allEntries get their positions written there too.
+    /// </summary>
+    /// <param name="nrOfEntriesToUpdate">Number of entries that have moved.</param>
+    /// <param name="ids">Ids of the entries.</param>
+    /// <param name="positions">The new positions of the entries.</param>
+    void UpdateEntriesBulk(uint32_t nrOfEntriesToUpdate, const uint32_t* ids, const PositionType* positions);
+
+    /// <summary>
+    /// Sets how far outside of its cell an entry can move before it changes cell, for both UpdateTable()
+    /// and UpdateEntriesBulk(). The same margin is used for every entry. Searches look that much further.
+    /// </summary>
+    /// <param name="margin">The distance, limited to less than half a cell.</param>
+    void SetHysteresis(float margin);
+
+    /// <summary>
+    /// Removes entries from the hash table. Their ids are free to be given to inserted entries.
+    /// </summary>
+    /// <param name="nrOfEntriesToRemove">Number of entries to remove.</param>
+    /// <param name="entryIndices">Ids of the entries to remove.</param>
+    void RemoveEntryFromTableBulk(uint32_t nrOfEntriesToRemove, uint32_t* entryIndices);
+
+    /// <summary>
+    /// Inserts new entries into the hash table, giving them ids of removed entries first
+    /// and growing the number of entries when there are none.
+    /// </summary>
+    /// <param name="nrOfEntriesToInsert">Number of entries to insert.</param>
+    /// <param name="positions">Positions of the new entries.</param>
+    /// <param name="ids">The ids given to the new entries.</param>
+    void InsertEntriesBulk(uint32_t nrOfEntriesToInsert, PositionType* positions, uint32_t* ids);
+
+    /// <summary>
+    /// Changes which array UpdateTable() reads positions from.
+    /// Entries with ids outside of the array keep the position they were inserted with.
+    /// </summary>
+    /// <param name="allEntries">The entry with id i is at place i.</param>
+    /// <param name="numberOfEntries">The number of Entry:s in allEntries.</param>
+    void AttachEntries(EntryType* inAllEntries, uint32_t numberOfEntries);
 
     /// <summary>
     /// Gets a number entites that are within a distance of a number of positions.
@@ -142,42 +470,330 @@ public:
     /// <param name="d">Radius of the search area.</param>
     /// <param name="maxEntities">No more than this number of entires will be returned.</param>
     /// <returns>A ordered list of entries sorted by distance from input positions.</returns>
-    CloseIdsAndNrOf GetCloseEntriesBulk(int32_t nrSearches, Position* positions, float d, int32_t maxEntities);
+    CloseIdsAndNrOf GetCloseEntriesBulk(int32_t nrSearches, PositionType* positions, float d, int32_t maxEntities);
+
+    /// <summary>
+    /// Gets a number entites that are within a distance of a number of positions, and in any of the layers
+    /// of a layer mask. Entries in none of them are passed over before their distance is tested, so they
+    /// don't take up any of the maxEntities.
+    /// </summary>
+    /// <param name="nrSearches">Number of searches.</param>
+    /// <param name="positions">Where to look for entites.</param>
+    /// <param name="d">Radius of the search area.</param>
+    /// <param name="maxEntities">No more than this number of entires will be returned.</param>
+    /// <param name="layerMask">The layers to look in, see SetLayers().</param>
+    /// <returns>A ordered list of entries sorted by distance from input positions.</returns>
+    CloseIdsAndNrOf GetCloseEntriesBulk(int32_t nrSearches, PositionType* positions, float d, int32_t maxEntities, uint32_t layerMask);
+
+    /// <summary>
+    /// Gets a number entites that are within a distance of a number of positions,
+    /// where every search has its own distance and max number of entries.
+    /// </summary>
+    /// <param name="nrSearches">Number of searches.</param>
+    /// <param name="positions">Where to look for entites.</param>
+    /// <param name="d">Radius of the search area of every search.</param>
+    /// <param name="maxEntities">No more than maxEntities[i] entries will be returned for search i.</param>
+    /// <returns>A ordered list of entries sorted by distance from input positions.</returns>
+    CloseIdsAndNrOf GetCloseEntriesBulk(int32_t nrSearches, PositionType* positions, const float* d, const int32_t* maxEntities);
 
     /// <summary>
-    /// Creates a square Spatial Hash table with length "size".
+    /// Gets the k closest entities to a number of positions, however far away they are. The offsets aren't
+    /// extended for this, past them the search goes on ring by ring of cells until no entry in the next ring
+    /// can be closer than the k:th closest entry found so far.
+    /// </summary>
+    /// <param name="nrSearches">Number of searches.</param>
+    /// <param name="positions">Where to look for entites.</param>
+    /// <param name="k">The number of entries to find for every position, fewer if there aren't that many.</param>
+    /// <returns>A ordered list of entries sorted by distance from input positions.</returns>
+    CloseIdsAndNrOf GetNearestEntriesBulk(int32_t nrSearches, PositionType* positions, int32_t k);
+
+    /// <summary>
+    /// Gets the entities inside of a number of axis aligned boxes, edges included. Only the cells the boxes overlap
+    /// are searched. The distance of an entry is from the center of its box.
+    /// </summary>
+    /// <param name="nrSearches">Number of boxes.</param>
+    /// <param name="lows">The lowest corner of every box.</param>
+    /// <param name="highs">The highest corner of every box.</param>
+    /// <param name="maxEntities">No more than this number of entries, the closest to the center, will be returned per box.</param>
+    /// <returns>A ordered list of entries sorted by distance from the centers of the boxes.</returns>
+    CloseIdsAndNrOf GetEntriesInBoxesBulk(int32_t nrSearches, const PositionType* lows, const PositionType* highs, int32_t maxEntities);
+
+    /// <summary>
+    /// Gets the entities closer than d to a number of line segments, like lines of fire. Only the cells along the
+    /// segments are searched. The distance of an entry is how far from the start of its segment the point of the
+    /// segment closest to it is, so the entries are in the order the line passes them.
+    /// </summary>
+    /// <param name="nrSearches">Number of segments.</param>
+    /// <param name="from">Where every segment starts.</param>
+    /// <param name="to">Where every segment ends.</param>
+    /// <param name="d">How close to a segment entries have to be.</param>
+    /// <param name="maxEntities">No more than this number of entries, the first along the segment, will be returned per segment.</param>
+    /// <returns>A ordered list of entries sorted by distance along the segments.</returns>
+    CloseIdsAndNrOf GetEntriesAlongSegmentsBulk(int32_t nrSearches, const PositionType* from, const PositionType* to, float d, int32_t maxEntities);
+
+    /// <summary>
+    /// Gets the entities a circle, or a sphere in 3d, touches when it moves in a straight line from one position to
+    /// another, like a fast mover between two updates. Only the cells along the way are searched. The distance of an
+    /// entry is how far the circle has moved when it first touches the entry, 0 if it touches it from the start.
+    /// </summary>
+    /// <param name="nrSearches">Number of circles.</param>
+    /// <param name="from">Where every circle starts.</param>
+    /// <param name="to">Where every circle ends up.</param>
+    /// <param name="radius">The radius of the circles.</param>
+    /// <param name="maxEntities">No more than this number of entries, the first touched, will be returned per circle.</param>
+    /// <returns>A ordered list of entries sorted by how far the circles moved before touching them.</returns>
+    CloseIdsAndNrOf GetEntriesSweptBulk(int32_t nrSearches, const PositionType* from, const PositionType* to, float radius, int32_t maxEntities);
+
+    /// <summary>
+    /// Gets the same entities as GetCloseEntriesBulk(), but into buffers owned by the caller. Nothing in the
+    /// Spatial Hash is changed, so several threads can search at the same time as long as it isn't updated meanwhile,
+    /// or while it is updated if it's double buffered, see SetDoubleBuffered(). The offsets aren't extended,
+    /// searches further than MaxSearchDistance() go on past them instead, see GetCloseEntriesBeyondOffsets().
+    /// </summary>
+    /// <param name="nrSearches">Number of searches.</param>
+    /// <param name="positions">Where to look for entites.</param>
+    /// <param name="d">Radius of the search area.</param>
+    /// <param name="maxEntities">No more than this number of entires will be returned.</param>
+    /// <param name="outNrOfEntries">Gets where the results of every search end in outCloseEntries, nrSearches long.</param>
+    /// <param name="outCloseEntries">Gets the results, capacity long.</param>
+    /// <param name="capacity">The number of IdWithDistance:s outCloseEntries has room for.</param>
+    /// <returns>How many searches were done, how many entries were written and if the buffer was too small.</returns>
+    SearchResult GetCloseEntriesInto(int32_t nrSearches, const PositionType* positions, float d, int32_t maxEntities, uint32_t* outNrOfEntries, IdWithDistance* outCloseEntries, uint32_t capacity) const;
+
+    /// <summary>
+    /// The largest distance the offsets reach, see SetMaxSearchDistance().
+    /// </summary>
+    float MaxSearchDistance() const;
+
+    /// <summary>
+    /// Gets the same entities as GetCloseEntriesBulk(), but the positions are sorted by cell and the positions
+    /// in a cell are searched together, so the entries of each cell around them are read once for all of them.
+    /// </summary>
+    /// <param name="nrSearches">Number of searches.</param>
+    /// <param name="positions">Where to look for entites.</param>
+    /// <param name="d">Radius of the search area.</param>
+    /// <param name="maxEntities">No more than this number of entires will be returned.</param>
+    /// <returns>A ordered list of entries sorted by distance from input positions, in the order of the positions.</returns>
+    CloseIdsAndNrOf GetCloseEntriesBulkGrouped(int32_t nrSearches, PositionType* positions, float d, int32_t maxEntities);
+
+    /// <summary>
+    /// Finds every pair of entries that are within a distance of each other. The table is walked cell by cell
+    /// and each cell is only compared with half of the cells around it, so every pair is tested once.
+    /// The pairs are in no particular order.
+    /// </summary>
+    /// <param name="d">The distance the entries of a pair have to be closer than.</param>
+    /// <returns>The pairs and how many they are. Valid until the next call.</returns>
+    ClosePairsAndNrOf GetClosePairs(float d);
+
+    /// <summary>
+    /// Finds the neighbours within a distance of every entry, from GetClosePairs().
+    /// nrOfEntries has one element per id, where the neighbours of that id end in allCloseEntries.
+    /// Removed ids have no neighbours. The neighbours of an id are not sorted by distance.
+    /// </summary>
+    /// <param name="d">The distance the neighbours have to be closer than.</param>
+    /// <returns>Uses the same arrays as GetCloseEntriesBulk(), so valid until the next search.</returns>
+    CloseIdsAndNrOf GetNeighboursOfAll(float d);
+
+    /// <summary>
+    /// Makes the precalculated offsets reach far enough for searches up to distance d.
+    /// Searches further than the offsets reach do this themselves, but it is slow so it's
+    /// better done once up front.
+    /// </summary>
+    /// <param name="d">The largest distance that is going to be searched.</param>
+    void SetMaxSearchDistance(float d);
+
+    /// <summary>
+    /// Picks the cell size and table size in Initilize() from how dense the entries are and the distance
+    /// that is usually searched, so that searches test as few entries and cells as they can.
+    /// </summary>
+    /// <param name="expectedSearchDistance">The typical search distance, 0 to keep the sizes given to the constructor.</param>
+    void SetAutoTune(float expectedSearchDistance);
+
+    // The side length of a cell.
+    float CellSize() const;
+
+    // The table is 2^SidePower() cells along every dimension.
+    uint32_t SidePower() const;
+
+    /// <summary>
+    /// Sets how the cells of the world are put into the table, see HashMode, and where the cells start.
+    /// The entries already in the Spatial Hash are sorted into their cells again.
+    /// </summary>
+    /// <param name="mode">The hash mode.</param>
+    /// <param name="inOrigin">Where the cells start, for a bounded table its lowest corner.</param>
+    void SetHashMode(HashMode mode, PositionType inOrigin);
+
+    // Counts the cells of the table that hold entries from several cells of the world.
+    AliasingStats GetAliasingStats() const;
+
+    /// <summary>
+    /// Turns double buffering of the cells on or off. When it's on, updates, inserts and removes write a copy of
+    /// the cells and publish it when they are done, while searches keep reading the cells that were published last.
+    /// GetCloseEntriesInto() on other threads can then run during an update, as long as the settings of the
+    /// Spatial Hash aren't changed meanwhile. Updates still have to be run one at a time. Costs the memory of a
+    /// second copy of the cells and copying them every update.
+    /// </summary>
+    /// <param name="enabled">If the cells are double buffered.</param>
+    void SetDoubleBuffered(bool enabled);
+
+    /// <summary>
+    /// Turns compact cells on or off. Compact cells keep where every entry is in its cell in 16 bits per axis,
+    /// instead of a copy of its position, so a search reads half of the bytes per coordinate with floats and a quarter
+    /// with doubles. Entries that are close even with the error of the quantization are found with their quantized
+    /// distance, which is off by up to about a 65000th of the cell size along every axis. Only entries in between
+    /// are tested with the position the Spatial Hash keeps by id. Those are written by updates, so compact cells
+    /// aren't used while double buffered and turning double buffering on turns them off.
+    /// </summary>
+    /// <param name="enabled">If the cells are compact.</param>
+    void SetCompact(bool enabled);
+
+    /// <summary>
+    /// Puts entries in layers, each bit of a layer mask is a layer and an entry can be in several. Searches
+    /// with a layer mask only find entries that share a bit with it. Entries are in every layer until they
+    /// are given a mask, and inserted entries start out in every layer again. The masks are kept next to the
+    /// positions in the cells from the first call on, before that the cells don't have room for them.
+    /// </summary>
+    /// <param name="nrOfEntries">Number of entries to give masks.</param>
+    /// <param name="ids">Ids of the entries, ids that aren't in use are ignored.</param>
+    /// <param name="layers">The layer mask of every entry.</param>
+    void SetLayers(uint32_t nrOfEntries, const uint32_t* ids, const uint32_t* layers);
+
+    /// <summary>
+    /// Runs UpdateTable() on the job queue of the Spatial Hash. The jobs of the queue are run one at a time
+    /// in the order they were submitted, on a thread of their own, so a search submitted after an update sees the update.
+    /// Until the job is done the Spatial Hash may only be updated through the queue. Searches that don't extend the
+    /// offsets, see SetMaxSearchDistance(), may run meanwhile if it's double buffered.
+    /// </summary>
+    /// <returns>The ticket of the job, for IsJobDone() and WaitForJob().</returns>
+    uint64_t SubmitUpdateTable();
+
+    /// <summary>
+    /// Runs UpdateEntriesBulk() on the job queue, see SubmitUpdateTable(). The arrays must be kept until the job is done.
+    /// </summary>
+    /// <param name="nrOfEntriesToUpdate">Number of entries that have moved.</param>
+    /// <param name="ids">Ids of the entries.</param>
+    /// <param name="positions">The new positions of the entries.</param>
+    /// <returns>The ticket of the job.</returns>
+    uint64_t SubmitUpdateEntries(uint32_t nrOfEntriesToUpdate, const uint32_t* ids, const PositionType* positions);
+
+    /// <summary>
+    /// Runs a bulk search on the job queue, see SubmitUpdateTable(), into buffers owned by the caller like
+    /// GetCloseEntriesInto(). The search is split over the worker threads like GetCloseEntriesBulk(), but only reads
+    /// the Spatial Hash, so any search that doesn't extend the offsets may run meanwhile. Updates still have to go
+    /// through the queue. The arrays must be kept until the job is done.
+    /// </summary>
+    /// <param name="nrSearches">Number of searches.</param>
+    /// <param name="positions">Where to look for entites.</param>
+    /// <param name="d">Radius of the search area.</param>
+    /// <param name="maxEntities">No more than this number of entires will be returned.</param>
+    /// <param name="outNrOfEntries">Gets where the results of every search end in outCloseEntries, nrSearches long.</param>
+    /// <param name="outCloseEntries">Gets the results, capacity long.</param>
+    /// <param name="capacity">The number of IdWithDistance:s outCloseEntries has room for.</param>
+    /// <param name="outResult">Gets how many searches were done and entries written when the job is done.</param>
+    /// <returns>The ticket of the job.</returns>
+    uint64_t SubmitCloseEntriesInto(int32_t nrSearches, PositionType* positions, float d, int32_t maxEntities, uint32_t* outNrOfEntries, IdWithDistance* outCloseEntries, uint32_t capacity, SearchResult* outResult);
+
+    // True when the job with the ticket, and every job submitted before it, is done.
+    bool IsJobDone(uint64_t ticket) const;
+
+    // Waits until the job with the ticket, and every job submitted before it, is done.
+    void WaitForJob(uint64_t ticket);
+
+    /// <summary>
+    /// Fills stats with what the Spatial Hash has done since the counters were reset, and how full the cells are.
+    /// </summary>
+    /// <param name="stats">Gets the stats.</param>
+    /// <param name="reset">If the counters and timers are set to zero afterwards.</param>
+    void GetStats(SpatialHashStats& stats, bool reset);
+
+    /// <summary>
+    /// Creates a Spatial Hash table with length "size" along every dimension.
     /// allEntries is the array used to input Entries for insertion into the hash table.
     /// </summary>
     /// <param name="size">The lengths of the sides of the table.</param>
-    SpatialHash(size_t size);
+    BasicSpatialHash(size_t size);
 
-    ~SpatialHash();
+    /// <summary>
+    /// Creates a Spatial Hash table with length 2^size along every dimension and cells that are cellSize wide.
+    /// </summary>
+    /// <param name="size">The lengths of the sides of the table, as a power of two.</param>
+    /// <param name="cellSize">The side length of a cell, 0 for cells as wide as the table is in cells.</param>
+    BasicSpatialHash(size_t size, float cellSize);
+
+    ~BasicSpatialHash();
 
 private:
+    using EnteredType = BasicEntered<Dim, Scalar>;
+    using QueryBufferType = QueryBuffer<Dim, Scalar>;
+    using CellStorageType = CellStorage<Dim, Scalar>;
+    using Key = CellKey<Dim>;
 
-    // Actual hash table. Stores only pointers to the data of allEntries and minimumOffsets.
+    // Actual hash table. Stores only where the offsets of each cell are.
     std::vector<Cell>* table;
 
+    // The entries of all the cells, sorted by cell. This is the generation updates write to.
+    std::shared_ptr<CellStorageType> cells;
+
+    // The generation searches read, only changed with atomic loads and stores. The same as cells unless double buffered.
+    std::shared_ptr<const CellStorageType> publishedCells;
+
+    // When double buffered, the generation that was published before the last one, written again once no search reads it.
+    std::shared_ptr<CellStorageType> spareCells;
+
+    // If updates write a copy of the cells, see SetDoubleBuffered().
+    bool doubleBuffered;
+
+    // The entries that moved cell in the last update, one list per part of the update that runs in parallel.
+    std::vector<std::vector<Mover>>* moverBuffers;
+
+    // All the entries that moved cell in the last update. Used in MoveEntries().
+    std::vector<Mover>* movers;
+
     /* All the entries to the spatial hash is stored in this list,
      * rather then in the actual hash table, to save space and make the
      * table more cash friendly. */
-    Entry* allEntries;
+    EntryType* allEntries;
 
     // Stores information about where in the hash map the entries are.
-    std::vector<Entered>* allEntered;
+    std::vector<EnteredType>* allEntered;
 
-    // Needed to keep track of the size of the number of elements in the allEntries array.
+    // Number of ids, in use or free. The size of allEntered.
     uint32_t numberOfAllEntries;
 
-    // The size of the table needs to be (2^n x 2^n) for simpler realization of modulo function.
-    const uint32_t sideLength;
+    // Needed to keep track of the size of the number of elements in the allEntries array.
+    uint32_t numberOfAttachedEntries;
+
+    // Ids of removed entries, that inserted entries can use.
+    std::vector<uint32_t>* freeIds;
+
+    // The hash value of entries that have been removed, they aren't in any cell.
+    static constexpr uint32_t removedHashValue = 0xFFFFFFFF;
+
+    // The size of the table needs to be 2^n along every dimension for simpler realization of modulo function.
+    uint32_t sideLength;
+
+    // Precalculated to save operations in the hash function. Of type Scalar so that far from the origin
+    // positions are put in the same cells as their coordinates say.
+    Scalar invCellSize;
+
+    // How far outside of its cell an entry can be before it's moved to another cell, and the same measured in cells.
+    float hysteresis;
+    float hysteresisInCells;
+
+    // Used for realisation of modulo function, the same along every dimension.
+    uint32_t mask;
 
-    // Precalculated to save operations in the hash function.
-    float invCellSize;
+    // The search distance AutoTune() tunes for, 0 when it's off.
+    float autoTuneDistance;
 
-    // Used for realisation of modulo function
-    const uint32_t xMask;
-    const uint32_t yMask;
+    // What searches and updates have done, only counted when built with SPATIALHASH_STATS.
+    StatCounters* statCounters;
+
+    // How the cells of the world are put into the table.
+    HashMode hashMode;
+
+    // Where cell (0, 0) of the world starts.
+    PositionType origin;
 
     // Sorted list of entries to return, from GetCloseEntities().
     std::vector<IdWithDistance>* closeEntries;
@@ -185,47 +801,300 @@ private:
     // Number of elements added to closeEntries for each GetCloseEntities().
     std::vector<uint32_t>* nrOfEntries;
 
+    // Threads that bulk searches are split over.
+    WorkerPool* workers;
+
+    // Runs the submitted updates and searches in order, on a thread of its own.
+    JobQueue* jobQueue;
+
+    // One QueryBuffer per part of a bulk search that is run in parallel.
+    std::vector<QueryBufferType>* queryBuffers;
+
+    // The same for the searches of the job queue, which run while the caller may use queryBuffers.
+    std::vector<QueryBufferType>* jobBuffers;
+
+    // The cell and index of every search of a grouped bulk search, sorted by cell.
+    std::vector<uint64_t>* searchOrder;
+
+    // The pairs found by GetClosePairs().
+    std::vector<IdPair>* closePairs;
+
+    // One list of pairs per part of GetClosePairs() that is run in parallel.
+    std::vector<std::vector<IdPair>>* pairBuffers;
+
+    // How many cells away from a cell the offsets reach.
+    int32_t ringRadius;
+
     // Contains the unlocalized offsets. That is offsets that aren't adapted to any certain cell.
-    std::vector<std::vector<int32_t>> xOffsetsToCalculate{};
-    std::vector<std::vector<int32_t>> yOffsetsToCalculate{};
+    std::vector<std::vector<Key>> offsetsToCalculate{};
+
+    // The smallest squared distance, measured in cells, between a cell and the cells of each step.
+    std::vector<float>* stepMinSquaredDistances;
+
+    // Stores the localized offsets that the cells away from the edges share, one step after another.
+    std::vector<int32_t>* offsetArena;
+
+    // Where each step of the shared offsets is in offsetArena.
+    std::vector<OffsetStep>* stepLists;
+
+    // Sorts all the entries in allEntered into cells according to their hash values.
+    void RebuildCells();
+
+    // Makes cells a generation that no search reads, before it is changed.
+    void BeginCellsUpdate();
+
+    // Lets the searches read the cells as they are now.
+    void PublishCells();
+
+    // The cells searches should read, which they keep until they are done with them.
+    std::shared_ptr<const CellStorageType> ReadCells() const;
 
-    // Stores all the offsets that the cells point to.
-    std::vector<std::vector<int32_t>*>* globalOffsets;
+    // Moves the entries in movers from their old cells to their new ones.
+    void MoveEntries();
 
-    // Inserts a entry from *allEntries into the hash table.
-    Entered InsertInTable(Entry* entry, uint32_t cellNr);
-    Entered InsertInTable(Entry* entry);
+    // Removes an entry from the hash table and frees its id.
+    void RemoveEntryFromTable(uint32_t entryIndex);
 
-    void RemoveEntryFromCell(Entered* entered);
+    // Grows the number of ids, the new ones are free.
+    void SetNumberOfEntries(uint32_t numberOfEntries);
 
-    // Checks if input entity has moved cell and if so inserts it into the new and removes it from the old.
-    void UpdateEntered(Entered* entered);
+    // Removes an entry from a cell.
+    void RemoveFromCell(uint32_t id, uint32_t cellNr);
 
-    void RemoveEntryFromTable(uint32_t entryIndex); // Not implemented yet.
+    // Adds an entry to a cell, if there's room.
+    bool AddToCell(uint32_t id, uint32_t cellNr);
 
-    void SetNumberOfEntries(uint32_t numberOfEntries); // Not implemented yet.
+    // Writes a position to a place of a cell in the cell storage.
+    void StorePosition(uint32_t place, uint32_t cellNr, const PositionType& pos);
 
-    // Gets entries from the Spatial Hash.
-    void GetCloseEntries(Position position, float d, int32_t maxEntities);
+    // Where along an axis a coordinate is in a cell, in 16 bits, for compact cells.
+    uint16_t Quantize(uint32_t axis, Scalar coordinate, int32_t cell) const;
+
+    // Finds the entries from a place in the cell storage that are closer to query than the square root of dSquared.
+    template<typename Hit>
+    void FindStoredWithinDistance(const CellStorageType& storage, uint32_t cellIndex, uint32_t place, uint32_t count, const Scalar* query, Scalar dSquared, uint32_t layerMask, Hit&& hit) const;
+
+    // The position of the entry at a place in the cell storage.
+    void StoredPosition(const CellStorageType& storage, uint32_t place, Scalar (&coordinates)[Dim]) const;
+
+    // The cell of the world the entry at a place in the cell storage is in.
+    Key StoredCell(const CellStorageType& storage, uint32_t place) const;
+
+    // Gets entries from the Spatial Hash and appends them to found.
+    void GetCloseEntries(const CellStorageType& storage, PositionType position, float d, int32_t maxEntities, uint32_t layerMask, std::vector<IdWithDistance>& found) const;
+
+    // GetCloseEntries() in HashMode::Hashed, which skips buckets holding other cells of the world.
+    void GetCloseEntriesHashed(const CellStorageType& storage, PositionType position, float d, int32_t maxEntities, uint32_t layerMask, std::vector<IdWithDistance>& found) const;
+
+    // The entries of a cell that are from another cell of the world than cell, for the stats.
+    uint32_t CountAliased(const CellStorageType& storage, uint32_t cellIndex, const Key& cell) const;
+
+    // Goes on with a search ring by ring of cells past the offsets, for as long as the rings can hold entries selection keeps.
+    void GetCloseEntriesBeyondOffsets(const CellStorageType& storage, const PositionType& pos, const Scalar* query, ClosestSelection& selection) const;
 
     // Gets entries from a cell, used by GetCloseEntries().
-    void GetCloseEntriesInCell(uint32_t cellIndex, Position pos, float d);
+    void GetCloseEntriesInCell(const CellStorageType& storage, uint32_t cellIndex, const Scalar* query, ClosestSelection& selection) const;
+
+    // Runs a group of searches from positions in the same cell, used by GetCloseEntriesBulkGrouped().
+    void GetCloseEntriesGroup(const CellStorageType& storage, uint32_t cellNr, uint32_t nrInGroup, float d, int32_t maxEntities, QueryBufferType& buffer);
 
-    // Sort closeEntries by distance. Used in GetCloseEntries().
-    void SortCloseEntries(int32_t from);
+    // Runs the searches [from, to), in cell order, of a grouped bulk search.
+    void GetCloseEntriesGroupedRange(const CellStorageType& storage, int32_t from, int32_t to, const uint64_t* order, PositionType* positions, float d, int32_t maxEntities, QueryBufferType& buffer);
 
-    // Overloaded hash function.
-    uint32_t CalculateCellNr(const Position pos);
+    // Gets the entries inside of a box, sorted by distance from its center.
+    void GetEntriesInBox(const CellStorageType& storage, const PositionType& low, const PositionType& high, int32_t maxEntities, std::vector<IdWithDistance>& found) const;
+
+    // Gets the entries closer than d to a segment, sorted by how far along it they are reached, by a swept circle if swept.
+    void GetEntriesAlongSegment(const CellStorageType& storage, const PositionType& from, const PositionType& to, float d, bool swept, int32_t maxEntities, std::vector<IdWithDistance>& found) const;
+
+    // The cells of the table the cells of the world span(row, first, last) along every row from lowCell to highCell are in.
+    template<typename Span>
+    void ShapeCells(const Key& lowCell, const Key& highCell, Span&& span, std::vector<uint32_t>& cellNrs) const;
+
+    // Tests the entries of some cells of the table with test(coordinates, squaredDistance), keeping the closest it accepts.
+    template<typename Test>
+    void GetEntriesInCells(const CellStorageType& storage, const std::vector<uint32_t>& cellNrs, int32_t maxEntities, Test&& test, std::vector<IdWithDistance>& found) const;
+
+    // Distance in cells from a position in a cell to the entries of a cell offset cells away along one side.
+    float CellGap(int32_t offset, float fraction) const;
+
+    // The squared distance in cells from a position in a cell to the entries of a cell offset cells away.
+    float SquaredCellGap(const Key& offset, const std::array<float, Dim>& fractions) const;
+
+    // The smallest squared distance in cells from a cell to the entries of the cells of a step.
+    float StepMinSquaredDistance(uint32_t step) const;
+
+    // Runs the searches of a bulk search, split over the worker threads. search(i, found) appends what search i finds to found.
+    template<typename Search>
+    CloseIdsAndNrOf RunSearches(int32_t nrSearches, const int32_t* maxEntities, uint32_t stride, Search&& search);
+
+    // Runs GetCloseEntriesInto() split over the worker threads, for the job queue.
+    SearchResult GetCloseEntriesIntoSplit(int32_t nrSearches, const PositionType* positions, float d, int32_t maxEntities, uint32_t* outNrOfEntries, IdWithDistance* outCloseEntries, uint32_t capacity) const;
+
+    // Runs a bulk search where search i has distance d[i * stride] and max number of entries maxEntities[i * stride].
+    CloseIdsAndNrOf GetCloseEntriesStrided(int32_t nrSearches, PositionType* positions, const float* d, const int32_t* maxEntities, uint32_t stride, uint32_t layerMask);
+
+    // The offsets to the cells GetClosePairs() compares a cell with, half of those closer than d.
+    void GeneratePairOffsets(float d, std::vector<PairOffset<Dim>>& pairOffsets);
+
+    // Finds every close pair in a generation of the cells into closePairs.
+    void FindClosePairs(const CellStorageType& storage, float d);
+
+    // Finds the close pairs where the first entry is in one of the cells [from, to).
+    void GetClosePairsInCells(const CellStorageType& storage, uint32_t from, uint32_t to, float d, const std::vector<PairOffset<Dim>>& pairOffsets, std::vector<IdPair>& pairs);
+
+    // GetClosePairsInCells() in HashMode::Hashed, where the offsets are between cells of the world.
+    void GetClosePairsInHashedCells(const CellStorageType& storage, uint32_t from, uint32_t to, float d, const std::vector<PairOffset<Dim>>& pairOffsets, std::vector<IdPair>& pairs);
+
+    // Hash function that keeps an entry in its current cell when it's within the hysteresis.
+    uint32_t CalculateCellNr(const PositionType pos, uint32_t currentCellNr) const;
 
     // Hash function.
-    uint32_t CalculateCellNr(const float x, const float y);
+    uint32_t CalculateCellNr(const PositionType pos) const;
+
+    // The cell of the world a position is in, neither wrapped nor clamped.
+    Key CellCoordinates(const PositionType& pos) const;
+
+    // The cell of the world a coordinate is in along an axis, kept inside of a billion cells from the origin.
+    int32_t CellCoordinate(uint32_t axis, double coordinate) const;
+
+    // Where a cell of the world is in the table, depending on the hash mode.
+    uint32_t HashCell(const Key& cell) const;
 
-    // Points all cells to their offsets.
+    // Where a coordinate of a cell of the world is in the table, wrapped or clamped. Not for HashMode::Hashed.
+    int32_t TableCoordinate(int32_t coordinate) const;
+
+    // The number of the cell at some coordinates of the table.
+    uint32_t TableCellNr(const Key& tableCell) const;
+
+    // The coordinates in the table of a cell.
+    Key TableCoordinates(uint32_t cellNr) const;
+
+    // Where in its cell a coordinate measured in cells is, clamped to the table in a bounded one.
+    float CellFraction(Scalar t) const;
+
+    // Where in its cell a position is along every axis.
+    std::array<float, Dim> CellFractions(const PositionType& pos) const;
+
+    // True if an entry that moved but kept its hash value can keep its place in the cell.
+    bool StaysInCell(PositionType from, PositionType to, uint32_t cellNr) const;
+
+    // Sets the tag of a cell, or marks it mixed, when an entry is added to it in HashMode::Hashed or to compact cells.
+    void TagCell(uint32_t cellNr, uint32_t count, PositionType pos);
+
+    // The cell of the world an entry in a cell of the table is from, which compact cells measure it from.
+    Key QuantizedCell(const PositionType& pos, uint32_t cellNr) const;
+
+    // The largest ring radius the offsets can have in the hash mode.
+    int32_t MaxRingRadius() const;
+
+    // Calculates the shared offsets and marks the cells near the edges.
     void InitializeOffsets();
 
-    // Points the offsets in a cell to their representation in globalOffsets. Used in InitializeOffsets().
-    void InitializeOffsetsInCell(uint32_t x, uint32_t y);
+    // The cell at an unlocalized offset from a cell near the edges, false if it's outside a bounded table.
+    bool OffsetCellNearEdge(const Key& tableCell, const Key& offset, uint32_t& offsetCell) const;
 
-    // Loads the unlocalized offsets from a file. Used in InitializeOffsets(). 
-    void ReadOffsetsFromFile();
+    // Generates the unlocalized offsets, sorted in rings by distance. Used in InitializeOffsets().
+    void GenerateOffsets();
+
+    // Increases the ring radius to reach a distance, true if the offsets need to be initialized again.
+    bool ExtendRings(float d);
+
+    // Sets the table size and cell size, empties the cells.
+    void Resize(uint32_t sidePower, float cellSize);
+
+    // Picks the table size and cell size for the entries and autoTuneDistance.
+    void AutoTune(const EntryType* entries, uint32_t numberOfEntries);
 };
+
+// The members are defined in SpatialHash.cpp, for these instantiations only.
+extern template class BasicSpatialHash<2, float>;
+extern template class BasicSpatialHash<3, float>;
+extern template class BasicSpatialHash<2, double>;
+extern template class BasicSpatialHash<3, double>;
+
+using SpatialHash = BasicSpatialHash<2, float>;
+using SpatialHash3f = BasicSpatialHash<3, float>;
+using SpatialHash2d = BasicSpatialHash<2, double>;
+using SpatialHash3d = BasicSpatialHash<3, double>;
+
+// Interop declarations.
+SPATIALHASH_API void* Start(uint32_t tableSize);
+SPATIALHASH_API void* StartWithCellSize(uint32_t tableSize, float cellSize);
+SPATIALHASH_API void SetAutoTune(float expectedSearchDistance, SpatialHash* spatialHash);
+SPATIALHASH_API void SetHashMode(uint32_t mode, float originX, float originY, SpatialHash* spatialHash);
+SPATIALHASH_API AliasingStats GetAliasing(SpatialHash* spatialHash);
+SPATIALHASH_API void GetStats(SpatialHashStats* stats, uint32_t reset, SpatialHash* spatialHash);
+SPATIALHASH_API uint32_t GetTableSize(SpatialHash* spatialHash);
+SPATIALHASH_API float GetCellSize(SpatialHash* spatialHash);
+SPATIALHASH_API void Init(uint32_t nrEntries, Entry* globalEntries, SpatialHash* spatialHash);
+SPATIALHASH_API uint32_t Stop(SpatialHash* spatialHash);
+SPATIALHASH_API CloseIdsAndNrOf GetEntries(int32_t nrOfPositions, Position* position, float d, int32_t maxEntities, SpatialHash* spatialHash);
+SPATIALHASH_API CloseIdsAndNrOf GetEntriesInLayers(int32_t nrOfPositions, Position* position, float d, int32_t maxEntities, uint32_t layerMask, SpatialHash* spatialHash);
+SPATIALHASH_API CloseIdsAndNrOf GetEntriesVarying(int32_t nrOfPositions, Position* position, float* d, int32_t* maxEntities, SpatialHash* spatialHash);
+SPATIALHASH_API CloseIdsAndNrOf GetNearest(int32_t nrOfPositions, Position* position, int32_t k, SpatialHash* spatialHash);
+SPATIALHASH_API CloseIdsAndNrOf GetEntriesInBoxes(int32_t nrOfBoxes, Position* lows, Position* highs, int32_t maxEntities, SpatialHash* spatialHash);
+SPATIALHASH_API CloseIdsAndNrOf GetEntriesAlongSegments(int32_t nrOfSegments, Position* from, Position* to, float d, int32_t maxEntities, SpatialHash* spatialHash);
+SPATIALHASH_API CloseIdsAndNrOf GetEntriesSwept(int32_t nrOfCircles, Position* from, Position* to, float radius, int32_t maxEntities, SpatialHash* spatialHash);
+SPATIALHASH_API SearchResult GetEntriesInto(int32_t nrOfPositions, Position* position, float d, int32_t maxEntities, uint32_t* nrOfEntries, IdWithDistance* closeEntries, uint32_t capacity, SpatialHash* spatialHash);
+SPATIALHASH_API CloseIdsAndNrOf GetEntriesGrouped(int32_t nrOfPositions, Position* position, float d, int32_t maxEntities, SpatialHash* spatialHash);
+SPATIALHASH_API ClosePairsAndNrOf GetPairs(float d, SpatialHash* spatialHash);
+SPATIALHASH_API CloseIdsAndNrOf GetNeighbours(float d, SpatialHash* spatialHash);
+SPATIALHASH_API void Update(SpatialHash* spatialHash);
+SPATIALHASH_API void UpdateEntries(uint32_t nrOfEntriesToUpdate, uint32_t* ids, Position* positions, SpatialHash* spatialHash);
+SPATIALHASH_API void SetHysteresis(float margin, SpatialHash* spatialHash);
+SPATIALHASH_API void Remove(uint32_t nrOfEntriesToRemove, uint32_t* entryIndices, SpatialHash* spatialHash);
+SPATIALHASH_API void Insert(uint32_t nrOfEntriesToInsert, Position* positions, uint32_t* ids, SpatialHash* spatialHash);
+SPATIALHASH_API void Attach(uint32_t nrEntries, Entry* globalEntries, SpatialHash* spatialHash);
+SPATIALHASH_API void SetSearchDistance(float d, SpatialHash* spatialHash);
+SPATIALHASH_API void SetDoubleBuffered(uint32_t enabled, SpatialHash* spatialHash);
+SPATIALHASH_API void SetCompact(uint32_t enabled, SpatialHash* spatialHash);
+SPATIALHASH_API void SetLayers(uint32_t nrOfEntries, uint32_t* ids, uint32_t* layers, SpatialHash* spatialHash);
+SPATIALHASH_API uint64_t SubmitUpdate(SpatialHash* spatialHash);
+SPATIALHASH_API uint64_t SubmitUpdateEntries(uint32_t nrOfEntriesToUpdate, uint32_t* ids, Position* positions, SpatialHash* spatialHash);
+SPATIALHASH_API uint64_t SubmitEntriesInto(int32_t nrOfPositions, Position* position, float d, int32_t maxEntities, uint32_t* nrOfEntries, IdWithDistance* closeEntries, uint32_t capacity, SearchResult* result, SpatialHash* spatialHash);
+SPATIALHASH_API uint32_t IsJobDone(uint64_t ticket, SpatialHash* spatialHash);
+SPATIALHASH_API void WaitForJob(uint64_t ticket, SpatialHash* spatialHash);
+
+// The interop of the other instantiations. The functions work like the ones above without the suffix, 3f for
+// SpatialHash3f, 2d for SpatialHash2d and 3d for SpatialHash3d. SetHashMode takes the origin as a position.
+#define SPATIALHASH_DECLARE_INTEROPS(suffix, dim, scalar) \
+    SPATIALHASH_API void* Start##suffix(uint32_t tableSize, float cellSize); \
+    SPATIALHASH_API void SetAutoTune##suffix(float expectedSearchDistance, BasicSpatialHash<dim, scalar>* spatialHash); \
+    SPATIALHASH_API void SetHashMode##suffix(uint32_t mode, BasicPosition<dim, scalar>* origin, BasicSpatialHash<dim, scalar>* spatialHash); \
+    SPATIALHASH_API AliasingStats GetAliasing##suffix(BasicSpatialHash<dim, scalar>* spatialHash); \
+    SPATIALHASH_API void GetStats##suffix(SpatialHashStats* stats, uint32_t reset, BasicSpatialHash<dim, scalar>* spatialHash); \
+    SPATIALHASH_API uint32_t GetTableSize##suffix(BasicSpatialHash<dim, scalar>* spatialHash); \
+    SPATIALHASH_API float GetCellSize##suffix(BasicSpatialHash<dim, scalar>* spatialHash); \
+    SPATIALHASH_API void Init##suffix(uint32_t nrEntries, BasicEntry<dim, scalar>* globalEntries, BasicSpatialHash<dim, scalar>* spatialHash); \
+    SPATIALHASH_API uint32_t Stop##suffix(BasicSpatialHash<dim, scalar>* spatialHash); \
+    SPATIALHASH_API CloseIdsAndNrOf GetEntries##suffix(int32_t nrOfPositions, BasicPosition<dim, scalar>* position, float d, int32_t maxEntities, BasicSpatialHash<dim, scalar>* spatialHash); \
+    SPATIALHASH_API CloseIdsAndNrOf GetEntriesInLayers##suffix(int32_t nrOfPositions, BasicPosition<dim, scalar>* position, float d, int32_t maxEntities, uint32_t layerMask, BasicSpatialHash<dim, scalar>* spatialHash); \
+    SPATIALHASH_API CloseIdsAndNrOf GetEntriesVarying##suffix(int32_t nrOfPositions, BasicPosition<dim, scalar>* position, float* d, int32_t* maxEntities, BasicSpatialHash<dim, scalar>* spatialHash); \
+    SPATIALHASH_API CloseIdsAndNrOf GetNearest##suffix(int32_t nrOfPositions, BasicPosition<dim, scalar>* position, int32_t k, BasicSpatialHash<dim, scalar>* spatialHash); \
+    SPATIALHASH_API CloseIdsAndNrOf GetEntriesInBoxes##suffix(int32_t nrOfBoxes, BasicPosition<dim, scalar>* lows, BasicPosition<dim, scalar>* highs, int32_t maxEntities, BasicSpatialHash<dim, scalar>* spatialHash); \
+    SPATIALHASH_API CloseIdsAndNrOf GetEntriesAlongSegments##suffix(int32_t nrOfSegments, BasicPosition<dim, scalar>* from, BasicPosition<dim, scalar>* to, float d, int32_t maxEntities, BasicSpatialHash<dim, scalar>* spatialHash); \
+    SPATIALHASH_API CloseIdsAndNrOf GetEntriesSwept##suffix(int32_t nrOfCircles, BasicPosition<dim, scalar>* from, BasicPosition<dim, scalar>* to, float radius, int32_t maxEntities, BasicSpatialHash<dim, scalar>* spatialHash); \
+    SPATIALHASH_API SearchResult GetEntriesInto##suffix(int32_t nrOfPositions, BasicPosition<dim, scalar>* position, float d, int32_t maxEntities, uint32_t* nrOfEntries, IdWithDistance* closeEntries, uint32_t capacity, BasicSpatialHash<dim, scalar>* spatialHash); \
+    SPATIALHASH_API CloseIdsAndNrOf GetEntriesGrouped##suffix(int32_t nrOfPositions, BasicPosition<dim, scalar>* position, float d, int32_t maxEntities, BasicSpatialHash<dim, scalar>* spatialHash); \
+    SPATIALHASH_API ClosePairsAndNrOf GetPairs##suffix(float d, BasicSpatialHash<dim, scalar>* spatialHash); \
+    SPATIALHASH_API CloseIdsAndNrOf GetNeighbours##suffix(float d, BasicSpatialHash<dim, scalar>* spatialHash); \
+    SPATIALHASH_API void Update##suffix(BasicSpatialHash<dim, scalar>* spatialHash); \
+    SPATIALHASH_API void UpdateEntries##suffix(uint32_t nrOfEntriesToUpdate, uint32_t* ids, BasicPosition<dim, scalar>* positions, BasicSpatialHash<dim, scalar>* spatialHash); \
+    SPATIALHASH_API void SetHysteresis##suffix(float margin, BasicSpatialHash<dim, scalar>* spatialHash); \
+    SPATIALHASH_API void Remove##suffix(uint32_t nrOfEntriesToRemove, uint32_t* entryIndices, BasicSpatialHash<dim, scalar>* spatialHash); \
+    SPATIALHASH_API void Insert##suffix(uint32_t nrOfEntriesToInsert, BasicPosition<dim, scalar>* positions, uint32_t* ids, BasicSpatialHash<dim, scalar>* spatialHash); \
+    SPATIALHASH_API void Attach##suffix(uint32_t nrEntries, BasicEntry<dim, scalar>* globalEntries, BasicSpatialHash<dim, scalar>* spatialHash); \
+    SPATIALHASH_API void SetSearchDistance##suffix(float d, BasicSpatialHash<dim, scalar>* spatialHash); \
+    SPATIALHASH_API void SetDoubleBuffered##suffix(uint32_t enabled, BasicSpatialHash<dim, scalar>* spatialHash); \
+    SPATIALHASH_API void SetCompact##suffix(uint32_t enabled, BasicSpatialHash<dim, scalar>* spatialHash); \
+    SPATIALHASH_API void SetLayers##suffix(uint32_t nrOfEntries, uint32_t* ids, uint32_t* layers, BasicSpatialHash<dim, scalar>* spatialHash); \
+    SPATIALHASH_API uint64_t SubmitUpdate##suffix(BasicSpatialHash<dim, scalar>* spatialHash); \
+    SPATIALHASH_API uint64_t SubmitUpdateEntries##suffix(uint32_t nrOfEntriesToUpdate, uint32_t* ids, BasicPosition<dim, scalar>* positions, BasicSpatialHash<dim, scalar>* spatialHash); \
+    SPATIALHASH_API uint64_t SubmitEntriesInto##suffix(int32_t nrOfPositions, BasicPosition<dim, scalar>* position, float d, int32_t maxEntities, uint32_t* nrOfEntries, IdWithDistance* closeEntries, uint32_t capacity, SearchResult* result, BasicSpatialHash<dim, scalar>* spatialHash); \
+    SPATIALHASH_API uint32_t IsJobDone##suffix(uint64_t ticket, BasicSpatialHash<dim, scalar>* spatialHash); \
+    SPATIALHASH_API void WaitForJob##suffix(uint64_t ticket, BasicSpatialHash<dim, scalar>* spatialHash);
+
+SPATIALHASH_DECLARE_INTEROPS(3f, 3, float)
+SPATIALHASH_DECLARE_INTEROPS(2d, 2, double)
+SPATIALHASH_DECLARE_INTEROPS(3d, 3, double)
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// With SPATIALHASH_STATS defined the Spatial Hash counts what its searches and updates do, see GetStats().
+// Without it the statements given to SPATIALHASH_COUNT() are left out, so the counting costs nothing.
+#if defined(SPATIALHASH_STATS)
+#define SPATIALHASH_COUNT(statements) statements
+#else
+#define SPATIALHASH_COUNT(statements)
+#endif
+
+/// <summary>
+/// What one search did. Counted without atomics while searching and added to StatCounters when the search is done.
+/// </summary>
+struct QueryCounters
+{
+    uint64_t stepsWalked = 0;
+    uint64_t cellsVisited = 0;
+    uint64_t cellsSkipped = 0;
+    uint64_t candidatesTested = 0;
+    uint64_t hits = 0;
+    uint64_t aliasingRejections = 0;
+};
+
+/// <summary>
+/// The parts of the work of the Spatial Hash that are timed.
+/// </summary>
+enum class Phase : uint32_t
+{
+    Update = 0,
+    Search = 1,
+    Pairs = 2,
+    Rebuild = 3,
+    NrOfPhases = 4
+};
+
+/// <summary>
+/// The totals of the counters since they were last reset. Searches on several threads add to them at once.
+/// </summary>
+struct StatCounters
+{
+    std::atomic<uint64_t> searches{ 0 };
+    std::atomic<uint64_t> stepsWalked{ 0 };
+    std::atomic<uint64_t> cellsVisited{ 0 };
+    std::atomic<uint64_t> cellsSkipped{ 0 };
+    std::atomic<uint64_t> candidatesTested{ 0 };
+    std::atomic<uint64_t> hits{ 0 };
+    std::atomic<uint64_t> aliasingRejections{ 0 };
+    std::atomic<uint64_t> updates{ 0 };
+    std::atomic<uint64_t> migrations{ 0 };
+    std::atomic<uint64_t> rebuilds{ 0 };
+    std::atomic<uint64_t> phaseNanoseconds[static_cast<uint32_t>(Phase::NrOfPhases)]{};
+
+    // Adds what a search did.
+    void Add(const QueryCounters& counters)
+    {
+        searches.fetch_add(1, std::memory_order_relaxed);
+        stepsWalked.fetch_add(counters.stepsWalked, std::memory_order_relaxed);
+        cellsVisited.fetch_add(counters.cellsVisited, std::memory_order_relaxed);
+        cellsSkipped.fetch_add(counters.cellsSkipped, std::memory_order_relaxed);
+        candidatesTested.fetch_add(counters.candidatesTested, std::memory_order_relaxed);
+        hits.fetch_add(counters.hits, std::memory_order_relaxed);
+        aliasingRejections.fetch_add(counters.aliasingRejections, std::memory_order_relaxed);
+    }
+
+    void Reset()
+    {
+        for (std::atomic<uint64_t>* counter : { &searches, &stepsWalked, &cellsVisited, &cellsSkipped, &candidatesTested,
+            &hits, &aliasingRejections, &updates, &migrations, &rebuilds })
+        {
+            counter->store(0, std::memory_order_relaxed);
+        }
+
+        for (std::atomic<uint64_t>& nanoseconds : phaseNanoseconds)
+        {
+            nanoseconds.store(0, std::memory_order_relaxed);
+        }
+    }
+};
+
+/// <summary>
+/// Adds the time from its construction to its destruction to a phase.
+/// </summary>
+class PhaseTimer
+{
+public:
+    PhaseTimer(StatCounters& inCounters, Phase inPhase) : counters(inCounters), phase(inPhase), start(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~PhaseTimer()
+    {
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+        counters.phaseNanoseconds[static_cast<uint32_t>(phase)].fetch_add(static_cast<uint64_t>(elapsed.count()), std::memory_order_relaxed);
+    }
+
+private:
+    StatCounters& counters;
+    Phase phase;
+    std::chrono::steady_clock::time_point start;
+};
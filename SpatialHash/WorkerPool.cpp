@@ -0,0 +1,109 @@
+#include "pch.h"
+#include "WorkerPool.h"
+
+using namespace std;
+
+WorkerPool::WorkerPool(uint32_t nrOfWorkers) : currentTask(nullptr), currentNrOfTasks(0), nextTask(0), generation(0), busyThreads(0), stopping(false)
+{
+    if (nrOfWorkers == 0)
+    {
+        nrOfWorkers = thread::hardware_concurrency();
+    }
+
+    // The calling thread is one of the workers.
+    for (uint32_t i = 1; i < nrOfWorkers; i++)
+    {
+        threads.emplace_back(&WorkerPool::WorkerLoop, this);
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        lock_guard<mutex> lock(stateMutex);
+        stopping = true;
+    }
+
+    workAvailable.notify_all();
+
+    for (size_t i = 0; i != threads.size(); i++)
+    {
+        threads[i].join();
+    }
+}
+
+void WorkerPool::Run(uint32_t nrOfTasks, const function<void(uint32_t)>& task)
+{
+    if (nrOfTasks == 0)
+    {
+        return;
+    }
+
+    // No need to wake anyone up if there is only one task to do.
+    if (nrOfTasks == 1 || threads.empty())
+    {
+        for (uint32_t i = 0; i < nrOfTasks; i++)
+        {
+            task(i);
+        }
+
+        return;
+    }
+
+    lock_guard<mutex> runLock(runMutex);
+
+    {
+        lock_guard<mutex> lock(stateMutex);
+        currentTask = &task;
+        currentNrOfTasks = nrOfTasks;
+        nextTask.store(0);
+        busyThreads = static_cast<uint32_t>(threads.size());
+        generation++;
+    }
+
+    workAvailable.notify_all();
+
+    TakeTasks();
+
+    // The task is owned by the caller so all threads have to be done with it before returning.
+    unique_lock<mutex> lock(stateMutex);
+    workDone.wait(lock, [this] { return busyThreads == 0; });
+    currentTask = nullptr;
+}
+
+void WorkerPool::WorkerLoop()
+{
+    uint64_t seenGeneration = 0;
+
+    while (true)
+    {
+        {
+            unique_lock<mutex> lock(stateMutex);
+            workAvailable.wait(lock, [&] { return stopping || generation != seenGeneration; });
+
+            if (stopping)
+            {
+                return;
+            }
+
+            seenGeneration = generation;
+        }
+
+        TakeTasks();
+
+        {
+            lock_guard<mutex> lock(stateMutex);
+            busyThreads--;
+        }
+
+        workDone.notify_one();
+    }
+}
+
+void WorkerPool::TakeTasks()
+{
+    for (uint32_t i = nextTask.fetch_add(1); i < currentNrOfTasks; i = nextTask.fetch_add(1))
+    {
+        (*currentTask)(i);
+    }
+}
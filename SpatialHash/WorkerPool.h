@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <cstdint>
+
+/// <summary>
+/// A small pool of threads that stay alive between calls, so that work can be split over
+/// several cores without the cost of starting new threads every frame.
+/// The thread calling Run() takes part in the work, so a pool with one worker runs everything
+/// on the calling thread.
+/// </summary>
+class WorkerPool
+{
+public:
+    /// <summary>
+    /// Creates a pool that runs tasks on nrOfWorkers threads, the calling thread included.
+    /// </summary>
+    /// <param name="nrOfWorkers">Number of threads to use, 0 means one per hardware thread.</param>
+    WorkerPool(uint32_t nrOfWorkers);
+
+    ~WorkerPool();
+
+    /// <summary>
+    /// Runs task(taskIndex) for every taskIndex in [0, nrOfTasks) and returns when all of them are done.
+    /// The tasks are handed out one at a time to whichever thread is free.
+    /// </summary>
+    /// <param name="nrOfTasks">Number of tasks to run.</param>
+    /// <param name="task">Called once per task index, from any of the threads in the pool.</param>
+    void Run(uint32_t nrOfTasks, const std::function<void(uint32_t)>& task);
+
+    // Number of threads that work on the tasks, the calling thread included.
+    uint32_t NrOfWorkers() const { return static_cast<uint32_t>(threads.size()) + 1; }
+
+private:
+
+    // The threads besides the calling thread.
+    std::vector<std::thread> threads;
+
+    // Only one Run() at a time.
+    std::mutex runMutex;
+
+    // Protects the fields below and is used with the condition variables.
+    std::mutex stateMutex;
+    std::condition_variable workAvailable;
+    std::condition_variable workDone;
+
+    // Current work, only valid while a Run() is in progress.
+    const std::function<void(uint32_t)>* currentTask;
+    uint32_t currentNrOfTasks;
+    std::atomic<uint32_t> nextTask;
+
+    // Incremented for every Run() so sleeping threads can tell that there is new work.
+    uint64_t generation;
+
+    // Number of threads that still are working on the current generation.
+    uint32_t busyThreads;
+
+    bool stopping;
+
+    // What the threads do, waits for work and then takes tasks until there are none left.
+    void WorkerLoop();
+
+    // Takes tasks from the current work until there are none left.
+    void TakeTasks();
+};
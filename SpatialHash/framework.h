@@ -1,5 +1,8 @@
 #pragma once
 
+#if defined(_WIN32)
 #define WIN32_LEAN_AND_MEAN             // Exclude rarely-used stuff from Windows headers
+#define NOMINMAX                        // The min and max macros collide with std::min and std::max
 // Windows Header Files
 #include <windows.h>
+#endif